@@ -1,11 +1,23 @@
 #ifndef _SCHED_H
 #define _SCHED_H
 
-#define NR_TASKS 64
+/*
+ * Linear space of a task (code, data, brk and stack), a multiple of 4MB.
+ * It is traded for the number of tasks: build with -DTASK_SIZE=0x1000000
+ * for 256 tasks of 16MB instead of 64 tasks of 64MB.
+ */
+#ifndef TASK_SIZE
+#define TASK_SIZE 0x4000000
+#endif
+#define NR_TASKS (0x40000000/(TASK_SIZE>>2))	/* 4GB / TASK_SIZE */
 #define HZ 100
+#define NR_PRIO 32	/* run queue levels, bigger counters share the top one */
+#define PIDHASH_SZ 256
+#define pid_hashfn(x) ((x) & (PIDHASH_SZ-1))
 
-#define FIRST_TASK task[0]
-#define LAST_TASK task[NR_TASKS-1]
+/* every task but task 0 */
+#define for_each_task(p) \
+for (p = task[0]->next_task ; p != task[0] ; p = p->next_task)
 
 #include <linux/head.h>
 #include <linux/fs.h>
@@ -74,6 +86,17 @@ struct tss_struct {
 	struct i387_struct i387;
 };
 
+struct task_struct;
+
+/*
+ * Runnable tasks are queued by counter, one circular list per level. The
+ * bitmap tells which levels are not empty.
+ */
+struct prio_array {
+	unsigned long bitmap;
+	struct task_struct * queue[NR_PRIO];
+};
+
 struct task_struct {
 /* these are hardcoded - don't touch */
 	long state;	/* -1 unrunnable, 0 runnable, >0 stopped */
@@ -102,6 +125,14 @@ struct task_struct {
 	struct desc_struct ldt[3];
 /* tss for this task */
 	struct tss_struct tss;
+/* run queue: nr is the slot in task[], array NULL if not queued */
+	long nr;
+	long epoch;
+	struct prio_array * array;
+	struct task_struct * run_next, * run_prev;
+/* task list and pid hash, see link_task() */
+	struct task_struct * next_task, * prev_task;
+	struct task_struct * pidhash_next;
 };
 
 /*
@@ -142,10 +173,19 @@ extern long startup_time;
 extern void sleep_on(struct task_struct ** p);
 extern void interruptible_sleep_on(struct task_struct ** p);
 extern void wake_up(struct task_struct ** p);
+extern void wake_up_process(struct task_struct * p);
+extern void wake_up_new(struct task_struct * p);
+extern void send_signal(struct task_struct * p, long sig);
+
+extern struct task_struct * find_task_by_pid(long pid);
+extern int get_free_slot(void);
+extern void link_task(struct task_struct * p);
+extern void unlink_task(struct task_struct * p);
 
 /*
  * Entry into gdt where to find first TSS. 0-nul, 1-cs, 2-ds, 3-syscall
- * 4-TSS0, 5-LDT0, 6-TSS1 etc ...
+ * 4-TSS0, 5-LDT0, 6-TSS1, 7-LDT1. Tasks don't own gdt entries: the two
+ * TSS/LDT pairs are loaded with the task we switch to, see schedule().
  */
 #define FIRST_TSS_ENTRY 4
 #define FIRST_LDT_ENTRY (FIRST_TSS_ENTRY+1)
@@ -153,19 +193,13 @@ extern void wake_up(struct task_struct ** p);
 #define _LDT(n) ((((unsigned long) n)<<4)+(FIRST_LDT_ENTRY<<3))
 #define ltr(n) __asm__("ltr %%ax"::"a" (_TSS(n)))
 #define lldt(n) __asm__("lldt %%ax"::"a" (_LDT(n)))
-#define str(n) \
-__asm__("str %%ax\n\t" \
-	"subl %2,%%eax\n\t" \
-	"shrl $4,%%eax" \
-	:"=a" (n) \
-	:"a" (0),"i" (FIRST_TSS_ENTRY<<3))
 /*
- *	switch_to(n) should switch tasks to task nr n, first
- * checking that n isn't the current task, in which case it does nothing.
- * This also clears the TS-flag if the task we switched to has used
- * tha math co-processor latest.
+ *	switch_to(n,p) switches to task p, whose TSS and LDT must have been
+ * set up in the gdt pair n, first checking that p isn't the current task,
+ * in which case it does nothing. This also clears the TS-flag if the task
+ * we switched to has used tha math co-processor latest.
  */
-#define switch_to(n) {\
+#define switch_to(n,p) {\
 struct {long a,b;} __tmp; \
 __asm__("cmpl %%ecx,_current\n\t" \
 	"je 1f\n\t" \
@@ -177,7 +211,7 @@ __asm__("cmpl %%ecx,_current\n\t" \
 	"clts\n" \
 	"1:" \
 	::"m" (*&__tmp.a),"m" (*&__tmp.b), \
-	"m" (last_task_used_math),"d" _TSS(n),"c" ((long) task[n])); \
+	"m" (last_task_used_math),"d" _TSS(n),"c" ((long) (p))); \
 }
 
 #define PAGE_ALIGN(n) (((n)+0xfff)&0xfffff000)
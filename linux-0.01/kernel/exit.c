@@ -12,18 +12,13 @@ int sys_close(int fd);
 
 void release(struct task_struct * p)
 {
-	int i;
-
 	if (!p)
 		return;
-	for (i=1 ; i<NR_TASKS ; i++)
-		if (task[i]==p) {
-			task[i]=NULL;
-			free_page((long)p);
-			schedule();
-			return;
-		}
-	panic("trying to release non-existent task");
+	if (p->nr <= 0 || p->nr >= NR_TASKS || task[p->nr] != p)
+		panic("trying to release non-existent task");
+	unlink_task(p);
+	free_page((long)p);
+	schedule();
 }
 
 static inline void send_sig(long sig,struct task_struct * p,int priv)
@@ -35,24 +30,24 @@ static inline void send_sig(long sig,struct task_struct * p,int priv)
 		current->euid==p->uid ||
 		current->uid==p->euid ||
 		current->euid==p->euid)
-		p->signal |= (1<<(sig-1));
+		send_signal(p,sig);
 }
 
 void do_kill(long pid,long sig,int priv)
 {
-	struct task_struct **p = NR_TASKS + task;
+	struct task_struct *p;
 
-	if (!pid) while (--p > &FIRST_TASK) {
-		if (*p && (*p)->pgrp == current->pid)
-			send_sig(sig,*p,priv);
-	} else if (pid>0) while (--p > &FIRST_TASK) {
-		if (*p && (*p)->pid == pid)
-			send_sig(sig,*p,priv);
-	} else if (pid == -1) while (--p > &FIRST_TASK)
-		send_sig(sig,*p,priv);
-	else while (--p > &FIRST_TASK)
-		if (*p && (*p)->pgrp == -pid)
-			send_sig(sig,*p,priv);
+	if (!pid) for_each_task(p) {
+		if (p->pgrp == current->pid)
+			send_sig(sig,p,priv);
+	} else if (pid>0) {
+		if ((p = find_task_by_pid(pid)) && p != task[0])
+			send_sig(sig,p,priv);
+	} else if (pid == -1) for_each_task(p)
+		send_sig(sig,p,priv);
+	else for_each_task(p)
+		if (p->pgrp == -pid)
+			send_sig(sig,p,priv);
 }
 
 int sys_kill(int pid,int sig)
@@ -63,13 +58,14 @@ int sys_kill(int pid,int sig)
 
 int do_exit(long code)
 {
+	struct task_struct *p;
 	int i;
 
 	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
 	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
-	for (i=0 ; i<NR_TASKS ; i++)
-		if (task[i] && task[i]->father == current->pid)
-			task[i]->father = 0;
+	for_each_task(p)
+		if (p->father == current->pid)
+			p->father = 0;
 	for (i=0 ; i<NR_OPEN ; i++)
 		if (current->filp[i])
 			sys_close(i);
@@ -85,8 +81,10 @@ int do_exit(long code)
 		current->state = TASK_ZOMBIE;
 		do_kill(current->father,SIGCHLD,1);
 		current->exit_code = code;
-	} else
+	} else {
+		current->state = TASK_ZOMBIE;	/* never queue it again */
 		release(current);
+	}
 	schedule();
 	return (-1);	/* just to suppress warnings */
 }
@@ -99,24 +97,24 @@ int sys_exit(int error_code)
 int sys_waitpid(pid_t pid,int * stat_addr, int options)
 {
 	int flag=0;
-	struct task_struct ** p;
+	struct task_struct * p;
 
 	verify_area(stat_addr,4);
 repeat:
-	for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-		if (*p && *p != current &&
-		   (pid==-1 || (*p)->pid==pid ||
-		   (pid==0 && (*p)->pgrp==current->pgrp) ||
-		   (pid<0 && (*p)->pgrp==-pid)))
-			if ((*p)->father == current->pid) {
+	for_each_task(p)
+		if (p != current &&
+		   (pid==-1 || p->pid==pid ||
+		   (pid==0 && p->pgrp==current->pgrp) ||
+		   (pid<0 && p->pgrp==-pid)))
+			if (p->father == current->pid) {
 				flag=1;
-				if ((*p)->state==TASK_ZOMBIE) {
-					put_fs_long((*p)->exit_code,
+				if (p->state==TASK_ZOMBIE) {
+					put_fs_long(p->exit_code,
 						(unsigned long *) stat_addr);
-					current->cutime += (*p)->utime;
-					current->cstime += (*p)->stime;
-					flag = (*p)->pid;
-					release(*p);
+					current->cutime += p->utime;
+					current->cstime += p->stime;
+					flag = p->pid;
+					release(p);
 					return flag;
 				}
 			}
@@ -43,7 +43,7 @@ int copy_mem(int nr,struct task_struct * p)
 		panic("We don't support separate I&D");
 	if (data_limit < code_limit)
 		panic("Bad data_limit");
-	new_data_base = new_code_base = nr * 0x4000000;
+	new_data_base = new_code_base = nr * TASK_SIZE;
 	set_base(p->ldt[1],new_code_base);
 	set_base(p->ldt[2],new_data_base);
 	if (copy_page_tables(old_data_base,new_data_base,data_limit)) {
@@ -100,8 +100,8 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 	p->tss.ds = ds & 0xffff;
 	p->tss.fs = fs & 0xffff;
 	p->tss.gs = gs & 0xffff;
-	p->tss.ldt = _LDT(nr);
 	p->tss.trace_bitmap = 0x80000000;
+	p->nr = nr;
 	if (last_task_used_math == current)
 		__asm__("fnsave %0"::"m" (p->tss.i387));
 	if (copy_mem(nr,p)) {
@@ -115,22 +115,19 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 		current->pwd->i_count++;
 	if (current->root)
 		current->root->i_count++;
-	set_tss_desc(gdt+(nr<<1)+FIRST_TSS_ENTRY,&(p->tss));
-	set_ldt_desc(gdt+(nr<<1)+FIRST_LDT_ENTRY,&(p->ldt));
-	task[nr] = p;	/* do this last, just in case */
+	link_task(p);	/* do this last, just in case */
+	wake_up_new(p);
 	return last_pid;
 }
 
 int find_empty_process(void)
 {
-	int i;
+	int nr;
 
 	repeat:
 		if ((++last_pid)<0) last_pid=1;
-		for(i=0 ; i<NR_TASKS ; i++)
-			if (task[i] && task[i]->pid == last_pid) goto repeat;
-	for(i=1 ; i<NR_TASKS ; i++)
-		if (!task[i])
-			return i;
-	return -EAGAIN;
+		if (find_task_by_pid(last_pid)) goto repeat;
+	if ((nr = get_free_slot()) < 0)
+		return -EAGAIN;
+	return nr;
 }
@@ -31,6 +31,11 @@ long startup_time=0;
 struct task_struct *current = &(init_task.task), *last_task_used_math = NULL;
 
 struct task_struct * task[NR_TASKS] = {&(init_task.task), };
+struct task_struct * pidhash[PIDHASH_SZ];
+
+static int free_slots[NR_TASKS];	/* unused entries of task[] */
+static int nr_free_slots = 0;
+static int tss_slot = 0;		/* gdt pair of the current task */
 
 long user_stack [ PAGE_SIZE>>2 ] ;
 
@@ -56,10 +61,110 @@ void math_state_restore()
 }
 
 /*
- *  'schedule()' is the scheduler function. This is GOOD CODE! There
- * probably won't be any reason to change this, as it should work well
- * in all circumstances (ie gives IO-bound processes good response etc).
- * The one thing you might take a look at is the signal-handler code here.
+ * The run queues. Tasks with counter left are in 'active', queued by
+ * counter, those which used it up are refilled and wait in 'expired'. When
+ * 'active' runs dry the two arrays are swapped: that is the point where
+ * the old scheduler recomputed every counter. Tasks not queued at that time
+ * (sleeping ones) catch up the refills they missed when they are woken up,
+ * by counting the swaps ('epoch'). Nothing here depends on NR_TASKS.
+ *
+ * The current task is never queued, schedule() puts it back.
+ */
+static struct prio_array prio_arrays[2];
+static struct prio_array * active = &prio_arrays[0];
+static struct prio_array * expired = &prio_arrays[1];
+static long epoch = 0;
+static long next_alarm = 0;	/* earliest alarm, 0 if none */
+
+#define save_flags_cli(x) \
+__asm__("pushfl ; popl %0 ; cli":"=r" (x))
+#define restore_flags(x) \
+__asm__("pushl %0 ; popfl"::"r" (x))
+
+/* highest bit set in a non-zero word */
+#define find_last_bit(x) ({ \
+long __n; \
+__asm__("bsrl %1,%0":"=r" (__n):"rm" (x)); \
+__n;})
+
+/* alarms are only ever set on the current task */
+#define note_alarm(p) \
+if ((p)->alarm && (!next_alarm || (p)->alarm < next_alarm)) \
+	next_alarm = (p)->alarm
+
+static void enqueue_task(struct task_struct * p)
+{
+	struct prio_array * array;
+	long n,lvl;
+
+	if (p->array)		/* already queued */
+		return;
+	if ((n = epoch - p->epoch) > 0) {
+		if (n > 32)	/* counter has converged by then */
+			n = 32;
+		while (n--)
+			p->counter = (p->counter >> 1) + p->priority;
+	}
+	p->epoch = epoch;
+	if (p->counter > 0)
+		array = active;
+	else {
+		p->counter = p->priority;
+		p->epoch = epoch+1;
+		array = expired;
+	}
+	lvl = (p->counter < NR_PRIO) ? p->counter : NR_PRIO-1;
+	if (array->queue[lvl]) {
+		p->run_next = array->queue[lvl];
+		p->run_prev = p->run_next->run_prev;
+		p->run_prev->run_next = p;
+		p->run_next->run_prev = p;
+	} else {
+		array->queue[lvl] = p->run_next = p->run_prev = p;
+		array->bitmap |= (unsigned long) 1<<lvl;
+	}
+	p->array = array;
+}
+
+static void dequeue_task(struct task_struct * p, long lvl)
+{
+	struct prio_array * array = p->array;
+
+	if (p->run_next == p) {
+		array->queue[lvl] = NULL;
+		array->bitmap &= ~((unsigned long) 1<<lvl);
+	} else {
+		p->run_prev->run_next = p->run_next;
+		p->run_next->run_prev = p->run_prev;
+		if (array->queue[lvl] == p)
+			array->queue[lvl] = p->run_next;
+	}
+	p->array = NULL;
+}
+
+/*
+ * Send SIGALRM to the tasks whose alarm went off. This walks the task
+ * table, but only when the earliest alarm is due.
+ */
+static void check_alarms(void)
+{
+	struct task_struct * p;
+
+	next_alarm = 0;
+	for_each_task(p)
+		if (p->alarm) {
+			if (p->alarm < jiffies) {
+				p->alarm = 0;
+				send_signal(p,SIGALRM);
+			} else
+				note_alarm(p);
+		}
+}
+
+/*
+ *  'schedule()' is the scheduler function. It picks the runnable task with
+ * the highest counter, as it always did, but from the run queues instead of
+ * scanning the task table.
  *
  *   NOTE!!  Task 0 is the 'idle' task, which gets called when no other
  * tasks can run. It can not be killed, and it cannot sleep. The 'state'
@@ -67,41 +172,42 @@ void math_state_restore()
  */
 void schedule(void)
 {
-	int i,next,c;
-	struct task_struct ** p;
-
-/* check alarm, wake up any interruptible tasks that have got a signal */
-
-	for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-		if (*p) {
-			if ((*p)->alarm && (*p)->alarm < jiffies) {
-					(*p)->signal |= (1<<(SIGALRM-1));
-					(*p)->alarm = 0;
-				}
-			if ((*p)->signal && (*p)->state==TASK_INTERRUPTIBLE)
-				(*p)->state=TASK_RUNNING;
-		}
+	struct task_struct * next;
+	struct prio_array * tmp;
+	long flags,lvl;
+
+	save_flags_cli(flags);
+	note_alarm(current);
+	if (next_alarm && next_alarm < jiffies)
+		check_alarms();
+	if (current->signal && current->state==TASK_INTERRUPTIBLE)
+		current->state=TASK_RUNNING;
+	if (current != task[0] && current->state == TASK_RUNNING &&
+	    task[current->nr] == current)	/* not released by exit */
+		enqueue_task(current);
 
 /* this is the scheduler proper: */
 
-	while (1) {
-		c = -1;
-		next = 0;
-		i = NR_TASKS;
-		p = &task[NR_TASKS];
-		while (--i) {
-			if (!*--p)
-				continue;
-			if ((*p)->state == TASK_RUNNING && (*p)->counter > c)
-				c = (*p)->counter, next = i;
-		}
-		if (c) break;
-		for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-			if (*p)
-				(*p)->counter = ((*p)->counter >> 1) +
-						(*p)->priority;
+	if (!active->bitmap && expired->bitmap) {
+		tmp = active;
+		active = expired;
+		expired = tmp;
+		epoch++;
+	}
+	if (active->bitmap) {
+		lvl = find_last_bit(active->bitmap);
+		next = active->queue[lvl];
+		dequeue_task(next,lvl);
+	} else
+		next = task[0];
+	if (next != current) {
+		tss_slot ^= 1;
+		set_tss_desc(gdt+(tss_slot<<1)+FIRST_TSS_ENTRY,&(next->tss));
+		set_ldt_desc(gdt+(tss_slot<<1)+FIRST_LDT_ENTRY,&(next->ldt));
+		next->tss.ldt = _LDT(tss_slot);
+		switch_to(tss_slot,next);
 	}
-	switch_to(next);
+	restore_flags(flags);
 }
 
 int sys_pause(void)
@@ -124,7 +230,7 @@ void sleep_on(struct task_struct **p)
 	current->state = TASK_UNINTERRUPTIBLE;
 	schedule();
 	if (tmp)
-		tmp->state=0;
+		wake_up_process(tmp);
 }
 
 void interruptible_sleep_on(struct task_struct **p)
@@ -140,24 +246,58 @@ void interruptible_sleep_on(struct task_struct **p)
 repeat:	current->state = TASK_INTERRUPTIBLE;
 	schedule();
 	if (*p && *p != current) {
-		(**p).state=0;
+		wake_up_process(*p);
 		goto repeat;
 	}
 	*p=NULL;
 	if (tmp)
-		tmp->state=0;
+		wake_up_process(tmp);
 }
 
 void wake_up(struct task_struct **p)
 {
 	if (p && *p) {
-		(**p).state=0;
+		wake_up_process(*p);
 		*p=NULL;
 	}
 }
 
+/*
+ * Make p runnable. The current task is not queued: if it is woken up
+ * before it had time to sleep, schedule() simply puts it back.
+ */
+void wake_up_process(struct task_struct * p)
+{
+	long flags;
+
+	save_flags_cli(flags);
+	p->state = TASK_RUNNING;
+	if (p != current && p != task[0])
+		enqueue_task(p);
+	restore_flags(flags);
+}
+
+/* queue a task fresh from fork(), it has no refill to catch up */
+void wake_up_new(struct task_struct * p)
+{
+	p->epoch = epoch;
+	p->array = NULL;
+	wake_up_process(p);
+}
+
+/* raise sig on p, waking it up if it waits interruptibly */
+void send_signal(struct task_struct * p, long sig)
+{
+	p->signal |= (1<<(sig-1));
+	if (p->state == TASK_INTERRUPTIBLE)
+		wake_up_process(p);
+}
+
 void do_timer(long cpl)
 {
+	note_alarm(current);
+	if (next_alarm && next_alarm < jiffies)
+		check_alarms();
 	if (cpl)
 		current->utime++;
 	else
@@ -168,6 +308,65 @@ void do_timer(long cpl)
 	schedule();
 }
 
+struct task_struct * find_task_by_pid(long pid)
+{
+	struct task_struct * p;
+
+	for (p = pidhash[pid_hashfn(pid)] ; p ; p = p->pidhash_next)
+		if (p->pid == pid)
+			return p;
+	return NULL;
+}
+
+/*
+ * Return a free entry of task[], or -1 if there is none. It stays free
+ * until link_task(), so fork() may give up in between.
+ */
+int get_free_slot(void)
+{
+	if (!nr_free_slots)
+		return -1;
+	return free_slots[nr_free_slots-1];
+}
+
+/*
+ * Put p (whose slot was given by get_free_slot()) in task[], the task list
+ * and the pid hash. Interrupts may walk those, hence the cli.
+ */
+void link_task(struct task_struct * p)
+{
+	struct task_struct ** h = &pidhash[pid_hashfn(p->pid)];
+	long flags;
+
+	save_flags_cli(flags);
+	if (!nr_free_slots || free_slots[--nr_free_slots] != p->nr)
+		panic("link_task: slot not reserved");
+	task[p->nr] = p;
+	p->next_task = task[0];
+	p->prev_task = task[0]->prev_task;
+	p->prev_task->next_task = p;
+	task[0]->prev_task = p;
+	p->pidhash_next = *h;
+	*h = p;
+	restore_flags(flags);
+}
+
+void unlink_task(struct task_struct * p)
+{
+	struct task_struct ** h = &pidhash[pid_hashfn(p->pid)];
+	long flags;
+
+	save_flags_cli(flags);
+	while (*h != p)
+		h = &(*h)->pidhash_next;
+	*h = p->pidhash_next;
+	p->prev_task->next_task = p->next_task;
+	p->next_task->prev_task = p->prev_task;
+	task[p->nr] = NULL;
+	free_slots[nr_free_slots++] = p->nr;
+	restore_flags(flags);
+}
+
 int sys_alarm(long seconds)
 {
 	current->alarm = (seconds>0)?(jiffies+HZ*seconds):0;
@@ -236,12 +435,14 @@ void sched_init(void)
 	set_tss_desc(gdt+FIRST_TSS_ENTRY,&(init_task.task.tss));
 	set_ldt_desc(gdt+FIRST_LDT_ENTRY,&(init_task.task.ldt));
 	p = gdt+2+FIRST_TSS_ENTRY;
-	for(i=1;i<NR_TASKS;i++) {
+	p->a=p->b=0;
+	p++;
+	p->a=p->b=0;
+	init_task.task.next_task = init_task.task.prev_task = &(init_task.task);
+	pidhash[pid_hashfn(0)] = &(init_task.task);
+	for(i=NR_TASKS-1;i>0;i--) {
 		task[i] = NULL;
-		p->a=p->b=0;
-		p++;
-		p->a=p->b=0;
-		p++;
+		free_slots[nr_free_slots++] = i;
 	}
 	ltr(0);
 	lldt(0);
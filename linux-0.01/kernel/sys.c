@@ -158,22 +158,20 @@ int sys_brk(unsigned long end_data_seg)
  */
 int sys_setpgid(int pid, int pgid)
 {
-	int i;
+	struct task_struct * p;
 
 	if (!pid)
 		pid = current->pid;
 	if (!pgid)
 		pgid = pid;
-	for (i=0 ; i<NR_TASKS ; i++)
-		if (task[i] && task[i]->pid==pid) {
-			if (task[i]->leader)
-				return -EPERM;
-			if (task[i]->session != current->session)
-				return -EPERM;
-			task[i]->pgrp = pgid;
-			return 0;
-		}
-	return -ESRCH;
+	if (!(p = find_task_by_pid(pid)))
+		return -ESRCH;
+	if (p->leader)
+		return -EPERM;
+	if (p->session != current->session)
+		return -EPERM;
+	p->pgrp = pgid;
+	return 0;
 }
 
 int sys_getpgrp(void)
@@ -99,13 +99,13 @@ void tty_init(void)
 
 void tty_intr(struct tty_struct * tty, int signal)
 {
-	int i;
+	struct task_struct * p;
 
 	if (tty->pgrp <= 0)
 		return;
-	for (i=0;i<NR_TASKS;i++)
-		if (task[i] && task[i]->pgrp==tty->pgrp)
-			task[i]->signal |= 1<<(signal-1);
+	for_each_task(p)
+		if (p->pgrp==tty->pgrp)
+			send_signal(p,signal);
 }
 
 static void sleep_if_empty(struct tty_queue * queue)
@@ -0,0 +1,400 @@
+/*
+ * apic.c -- local APIC and I/O APIC support.
+ *
+ * Both are programmed through memory-mapped registers, mapped uncached by
+ * map_mmio(). The I/O APIC registers are accessed indirectly: the register
+ * index is written to IOREGSEL and its value read or written in IOWIN.
+ */
+#include <common.h>
+#include <apic.h>
+#include <mptable.h>
+#include <paging.h>
+#include <isr.h>
+#include <timer.h>
+#include <clock.h>
+#include <spinlock.h>
+
+
+/* local APIC registers, offsets from the base */
+#define	LAPIC_ID	0x020
+#define	LAPIC_VER	0x030
+#define	LAPIC_TPR	0x080 /* task priority */
+#define	LAPIC_EOI	0x0B0
+#define	LAPIC_SVR	0x0F0 /* spurious interrupt vector */
+#define	LAPIC_ESR	0x280 /* error status */
+#define	LAPIC_ICR_LO	0x300 /* interrupt command */
+#define	LAPIC_ICR_HI	0x310
+#define	LAPIC_LVT_TIMER	0x320
+#define	LAPIC_LVT_LINT0	0x350
+#define	LAPIC_LVT_LINT1	0x360
+#define	LAPIC_LVT_ERROR	0x370
+#define	LAPIC_TICR	0x380 /* timer initial count */
+#define	LAPIC_TCCR	0x390 /* timer current count */
+#define	LAPIC_TDCR	0x3E0 /* timer divide configuration */
+
+#define	LAPIC_SVR_ENABLE	0x100
+#define	LVT_MASKED		0x10000
+#define	LVT_NMI			0x400 /* delivery mode */
+#define	LVT_TIMER_PERIODIC	0x20000
+#define	TDCR_DIV16		0x3
+
+#define	ICR_FIXED		0x000
+#define	ICR_INIT		0x500
+#define	ICR_STARTUP		0x600
+#define	ICR_PENDING		0x1000 /* delivery status */
+#define	ICR_ASSERT		0x4000
+#define	ICR_LEVEL		0x8000
+
+/* the IA32_APIC_BASE MSR */
+#define	MSR_APIC_BASE		0x1B
+#define	APIC_BASE_ENABLE	0x800
+#define	CPUID_APIC		0x200 /* cpuid(1) %edx bit */
+
+/* I/O APIC registers */
+#define	IOAPIC_IOREGSEL	0x00
+#define	IOAPIC_IOWIN	0x10
+#define	IOAPIC_VER	0x01
+#define	IOAPIC_REDTBL(n)	(0x10 + 2 * (n)) /* low word, high word is +1 */
+
+#define	IOREDIR_ACTIVE_LOW	0x2000
+#define	IOREDIR_LEVEL		0x8000
+#define	IOREDIR_MASKED		0x10000
+
+/* the Interrupt Mode Configuration Register, see the MP specification 3.6.2 */
+#define	IMCR_ADDR	0x22
+#define	IMCR_DATA	0x23
+#define	IMCR_SELECT	0x70
+#define	IMCR_APIC	0x01
+
+#define	CALIBRATE_MS	10
+
+struct ioapic {
+	volatile uint32_t	*io_base;
+	uint32_t		 io_nredir; /* number of inputs */
+};
+
+
+static volatile uint32_t	*lapic_base;
+static struct ioapic		 ioapics[MP_MAXIOAPIC];
+static uint32_t			 lapic_tmr_khz;
+static struct spinlock		 ioapic_lock = SPINLOCK_INITIALIZER("ioapic");
+
+static void	ioapic_pic_eoi(uint32_t irq);
+
+static struct intr_pic ioapic_pic = {
+	.ip_name = "ioapic",
+	.ip_eoi  = &ioapic_pic_eoi,
+	.ip_mask = &ioapic_mask,
+};
+
+
+#define	LAPIC(r)	lapic_base[(r) / sizeof(uint32_t)]
+
+
+static int
+has_apic(void)
+{
+	uint32_t eax = 1, ebx, ecx, edx;
+
+	asm volatile ("cpuid"
+	    : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+	return ((edx & CPUID_APIC) != 0);
+}
+
+
+static uint64_t
+rdmsr(uint32_t msr)
+{
+	uint32_t lo, hi;
+
+	asm volatile ("rdmsr" : "=a" (lo), "=d" (hi) : "c" (msr));
+	return (((uint64_t)hi << 32) | lo);
+}
+
+
+static void
+wrmsr(uint32_t msr, uint64_t v)
+{
+
+	asm volatile ("wrmsr" : : "c" (msr), "a" ((uint32_t)v),
+	    "d" ((uint32_t)(v >> 32)));
+}
+
+
+static uint32_t
+ioapic_read(struct ioapic *io, uint32_t reg)
+{
+
+	io->io_base[IOAPIC_IOREGSEL / sizeof(uint32_t)] = reg;
+	return (io->io_base[IOAPIC_IOWIN / sizeof(uint32_t)]);
+}
+
+
+static void
+ioapic_write(struct ioapic *io, uint32_t reg, uint32_t v)
+{
+
+	io->io_base[IOAPIC_IOREGSEL / sizeof(uint32_t)] = reg;
+	io->io_base[IOAPIC_IOWIN / sizeof(uint32_t)] = v;
+}
+
+
+/*
+ * Find the I/O APIC input wired to irq, return -1 if there is none. *flagsp is
+ * set to the MP polarity and trigger mode flags.
+ */
+static int
+ioapic_lookup(uint32_t irq, struct ioapic **iop, uint32_t *intinp,
+    uint32_t *flagsp)
+{
+	struct mp_irq *r;
+
+	if (mp_config.mp_nioapic == 0)
+		return (-1);
+	if (irq < MP_NISAIRQ) {
+		r = &mp_config.mp_isa_irqs[irq];
+		*iop    = &ioapics[r->mr_ioapic];
+		*intinp = r->mr_intin;
+		*flagsp = r->mr_flags;
+	} else {
+		/* PCI interrupts, which are active low and level triggered. */
+		*iop    = &ioapics[0];
+		*intinp = irq;
+		*flagsp = (MP_IRQ_LEVEL << 2) | MP_IRQ_ACTIVE_LOW;
+	}
+	return (*intinp < (*iop)->io_nredir ? 0 : -1);
+}
+
+
+void
+ioapic_route(uint32_t irq, uint32_t vector, uint32_t dest, int masked)
+{
+	struct ioapic *io;
+	uint32_t intin, flags, lo, eflags;
+
+	if (ioapic_lookup(irq, &io, &intin, &flags) == -1)
+		PANIC("no I/O APIC input for IRQ %u", irq);
+
+	lo = vector;
+	if (MP_IRQ_POLARITY(flags) == MP_IRQ_ACTIVE_LOW)
+		lo |= IOREDIR_ACTIVE_LOW;
+	if (MP_IRQ_TRIGGER(flags) == MP_IRQ_LEVEL)
+		lo |= IOREDIR_LEVEL;
+	if (masked)
+		lo |= IOREDIR_MASKED;
+
+	eflags = spin_lock_irqsave(&ioapic_lock);
+	ioapic_write(io, IOAPIC_REDTBL(intin) + 1, dest << 24);
+	ioapic_write(io, IOAPIC_REDTBL(intin), lo);
+	spin_unlock_irqrestore(&ioapic_lock, eflags);
+}
+
+
+void
+ioapic_mask(uint32_t irq, int masked)
+{
+	struct ioapic *io;
+	uint32_t intin, flags, lo, eflags;
+
+	if (ioapic_lookup(irq, &io, &intin, &flags) == -1)
+		return;
+	eflags = spin_lock_irqsave(&ioapic_lock);
+	lo = ioapic_read(io, IOAPIC_REDTBL(intin));
+	if (masked)
+		lo |= IOREDIR_MASKED;
+	else
+		lo &= ~IOREDIR_MASKED;
+	ioapic_write(io, IOAPIC_REDTBL(intin), lo);
+	spin_unlock_irqrestore(&ioapic_lock, eflags);
+}
+
+
+static void
+ioapic_pic_eoi(uint32_t irq)
+{
+
+	lapic_eoi();
+}
+
+
+int
+lapic_present(void)
+{
+
+	return (lapic_base != NULL);
+}
+
+
+uint32_t
+lapic_id(void)
+{
+
+	return (LAPIC(LAPIC_ID) >> 24);
+}
+
+
+void
+lapic_eoi(void)
+{
+
+	LAPIC(LAPIC_EOI) = 0;
+}
+
+
+void
+lapic_init(void)
+{
+
+	/* the BIOS may have disabled it globally. */
+	wrmsr(MSR_APIC_BASE, rdmsr(MSR_APIC_BASE) | APIC_BASE_ENABLE);
+
+	/*
+	 * LINT0 is the 8259 input in virtual wire mode, we don't want it
+	 * anymore. LINT1 is the NMI.
+	 */
+	LAPIC(LAPIC_LVT_TIMER) = LVT_MASKED;
+	LAPIC(LAPIC_LVT_LINT0) = LVT_MASKED;
+	LAPIC(LAPIC_LVT_LINT1) = LVT_NMI;
+	LAPIC(LAPIC_LVT_ERROR) = LVT_MASKED;
+	/* the ESR must be written before being read. */
+	LAPIC(LAPIC_ESR) = 0;
+	LAPIC(LAPIC_ESR) = 0;
+
+	/* accept every interrupt and enable the APIC. */
+	LAPIC(LAPIC_TPR) = 0;
+	LAPIC(LAPIC_SVR) = LAPIC_SVR_ENABLE | LAPIC_SPURIOUS;
+	lapic_eoi();
+}
+
+
+/* send an interrupt command to the CPU with the local APIC ID dest. */
+static void
+lapic_icr(uint32_t dest, uint32_t cmd)
+{
+
+	LAPIC(LAPIC_ICR_HI) = dest << 24;
+	LAPIC(LAPIC_ICR_LO) = cmd;
+	while (LAPIC(LAPIC_ICR_LO) & ICR_PENDING)
+		asm volatile ("pause");
+}
+
+
+void
+lapic_ipi(uint32_t dest, uint32_t vector)
+{
+	uint32_t eflags;
+
+	/* the ICR is two registers, don't let an interrupt get in between. */
+	eflags = intr_disable();
+	lapic_icr(dest, ICR_FIXED | ICR_ASSERT | vector);
+	intr_restore(eflags);
+}
+
+
+void
+lapic_start_ap(uint32_t dest, uint32_t addr)
+{
+	int i;
+
+	/* the universal startup algorithm, see the MP specification B.4. */
+	lapic_icr(dest, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+	clock_delay_us(200);
+	lapic_icr(dest, ICR_INIT | ICR_LEVEL);
+	clock_delay_us(10000);
+	for (i = 0; i < 2; i++) {
+		lapic_icr(dest, ICR_STARTUP | (addr >> 12));
+		clock_delay_us(200);
+	}
+}
+
+
+/* count the timer decrements during CALIBRATE_MS using the PIT channel 2. */
+static uint32_t
+lapic_timer_calibrate(void)
+{
+	uint32_t latch = PIT_FREQ / (1000 / CALIBRATE_MS);
+	uint32_t count;
+
+	LAPIC(LAPIC_TDCR) = TDCR_DIV16;
+	LAPIC(LAPIC_LVT_TIMER) = LVT_MASKED;
+
+	outb(PIT_GATE, (inb(PIT_GATE) & ~0x2) | 0x1);
+	outb(PIT_CMD, PIT_CH2_ONESHOT);
+	outb(PIT_CH2, latch & 0xFF);
+	outb(PIT_CH2, (latch >> 8) & 0xFF);
+
+	LAPIC(LAPIC_TICR) = 0xFFFFFFFF;
+	while ((inb(PIT_GATE) & PIT_CH2_OUT) == 0)
+		;
+	count = 0xFFFFFFFF - LAPIC(LAPIC_TCCR);
+	LAPIC(LAPIC_TICR) = 0;
+
+	return (count / CALIBRATE_MS);
+}
+
+
+uint32_t
+lapic_timer_khz(void)
+{
+
+	return (lapic_tmr_khz);
+}
+
+
+void
+lapic_timer_periodic(uint32_t vector, uint32_t count)
+{
+
+	LAPIC(LAPIC_TDCR) = TDCR_DIV16;
+	LAPIC(LAPIC_LVT_TIMER) = LVT_TIMER_PERIODIC | vector;
+	LAPIC(LAPIC_TICR) = count;
+}
+
+
+void
+lapic_timer_oneshot(uint32_t vector, uint32_t count)
+{
+
+	LAPIC(LAPIC_LVT_TIMER) = vector;
+	LAPIC(LAPIC_TICR) = (count > 0 ? count : 1);
+}
+
+
+int
+init_apic(void)
+{
+	struct ioapic *io;
+	uint32_t i, n;
+
+	if (!has_apic() || mp_probe() == -1)
+		return (-1);
+
+	lapic_base = map_mmio(mp_config.mp_lapic_addr);
+	lapic_init();
+	lapic_tmr_khz = lapic_timer_calibrate();
+
+	for (i = 0; i < mp_config.mp_nioapic; i++) {
+		io = &ioapics[i];
+		io->io_base = map_mmio(mp_config.mp_ioapics[i].mi_addr);
+		io->io_nredir = ((ioapic_read(io, IOAPIC_VER) >> 16) & 0xFF) + 1;
+		for (n = 0; n < io->io_nredir; n++)
+			ioapic_write(io, IOAPIC_REDTBL(n), IOREDIR_MASKED);
+	}
+
+	/* disconnect the 8259 PICs, with the IMCR in PIC mode. */
+	if (mp_config.mp_imcr) {
+		outb(IMCR_ADDR, IMCR_SELECT);
+		outb(IMCR_DATA, IMCR_APIC);
+	}
+	outb(0x21, 0xFF);
+	outb(0xA1, 0xFF);
+
+	/* IRQ2 is the 8259 cascade, the timer is usually wired there. */
+	for (i = 0; i < MP_NISAIRQ; i++) {
+		if (i != 2)
+			ioapic_route(i, IRQ0 + i, lapic_id(), 0);
+	}
+	intr_pic = &ioapic_pic;
+
+	return (0);
+}
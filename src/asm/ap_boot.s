@@ -0,0 +1,70 @@
+;
+; ap_boot.s -- Application processors startup trampoline.
+;
+; An AP wakes up in real mode at the address given by the startup IPI. This
+; code is copied to AP_BOOT_ADDR (see cpu.h) by smp_start() and must not use
+; absolute addresses, only offsets through the REL() macro. It switches to
+; protected mode with a temporary GDT, enables paging and calls the C entry
+; point with the AP struct cpu_info on its own stack, all found in the
+; ap_boot_args block filled by smp_start().
+;
+
+AP_BOOT_ADDR    equ 0x8000
+%define REL(x)  (AP_BOOT_ADDR + (x) - ap_trampoline)
+
+[GLOBAL ap_trampoline]
+[GLOBAL ap_trampoline_end]
+[GLOBAL ap_boot_args]
+
+[BITS 16]
+ap_trampoline:
+    cli
+    xor ax, ax
+    mov ds, ax
+    lgdt [REL(ap_gdt_ptr)]
+    mov eax, cr0
+    or eax, 0x1               ; PE
+    mov cr0, eax
+    jmp dword 0x08:REL(ap_pmode)
+
+[BITS 32]
+ap_pmode:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    mov eax, [REL(ap_boot_cr3)]
+    mov cr3, eax
+    mov eax, cr0
+    or eax, 0x80000000        ; PG
+    mov cr0, eax
+
+    mov esp, [REL(ap_boot_stack)]
+    push dword [REL(ap_boot_cpu)]
+    mov eax, [REL(ap_boot_entry)]
+    call eax                  ; never returns
+.halt:
+    cli
+    hlt
+    jmp .halt
+
+align 8
+ap_gdt:
+    dq 0                      ; Null segment
+    dq 0x00CF9A000000FFFF     ; Code segment
+    dq 0x00CF92000000FFFF     ; Data segment
+ap_gdt_ptr:
+    dw ap_gdt_ptr - ap_gdt - 1
+    dd REL(ap_gdt)
+
+; struct ap_boot_args in cpu.c
+align 4
+ap_boot_args:
+ap_boot_cr3:    dd 0
+ap_boot_stack:  dd 0
+ap_boot_entry:  dd 0
+ap_boot_cpu:    dd 0
+ap_trampoline_end:
@@ -1,18 +1,19 @@
+; NOTE: every IDT entry is an interrupt gate, so the processor already
+; cleared IF when entering the stubs and iret restores it: no cli/sti here.
+
 %macro ISR_NOERRCODE 1  ; define a macro, taking one parameter
     [GLOBAL isr%1]        ; %1 accesses the first parameter.
     isr%1:
-        cli
         push byte 0
         push byte %1
-        jmp isr_common_stub
+        jmp intr_common_stub
 %endmacro
 
 %macro ISR_ERRCODE 1
     [GLOBAL isr%1]
     isr%1:
-        cli
         push byte %1
-        jmp isr_common_stub
+        jmp intr_common_stub
 %endmacro
 
 ISR_NOERRCODE  0
@@ -49,46 +50,14 @@ ISR_NOERRCODE 30
 ISR_NOERRCODE 31
 
 
-; In isr.c
-[EXTERN isr_handler]
-; This is our common ISR stub. It saves the processor state, sets
-; up for kernel mode segments, calls the C-level fault handler,
-; and finally restores the stack frame.
-isr_common_stub:
-    pusha                    ; Pushes edi,esi,ebp,esp,ebx,edx,ecx,eax
-
-    mov ax, ds               ; Lower 16-bits of eax = ds.
-    push eax                 ; save the data segment descriptor
-
-    mov ax, 0x10  ; load the kernel data segment descriptor
-    mov ds, ax
-    mov es, ax
-    mov fs, ax
-    mov gs, ax
-
-    call isr_handler
-
-    pop eax        ; reload the original data segment descriptor
-    mov ds, ax
-    mov es, ax
-    mov fs, ax
-    mov gs, ax
-
-    popa                     ; Pops edi,esi,ebp...
-    add esp, 8     ; Cleans up the pushed error code and pushed ISR number
-    sti
-    iret           ; pops 5 things at once: CS, EIP, EFLAGS, SS, and ESP
-
-
 ; This macro creates a stub for an IRQ - the first parameter is
 ; the IRQ number, the second is the ISR number it is remapped to.
 %macro IRQ 2
 [GLOBAL irq%1]
     irq%1:
-        cli
         push byte 0
         push byte %2
-        jmp irq_common_stub
+        jmp intr_common_stub
 %endmacro
 
 IRQ  0, 32
@@ -107,34 +76,57 @@ IRQ 12, 44
 IRQ 13, 45
 IRQ 14, 46
 IRQ 15, 47
+IRQ 16, 48
+IRQ 17, 49
+IRQ 18, 50
+IRQ 19, 51
+IRQ 20, 52
+IRQ 21, 53
+IRQ 22, 54
+IRQ 23, 55
+IRQ 24, 56
+IRQ 25, 57
+IRQ 26, 58
+IRQ 27, 59
+IRQ 28, 60
+IRQ 29, 61
+IRQ 30, 62
+IRQ 31, 63
+
+; The local APIC spurious interrupt (LAPIC_SPURIOUS in apic.h). It must not
+; be acknowledged, there is nothing to do.
+[GLOBAL isr_spurious]
+isr_spurious:
+    iret
 
 
 ; In isr.c
-[EXTERN irq_handler]
-; This is our common IRQ stub. It saves the processor state, sets
-; up for kernel mode segments, calls the C-level fault handler,
-; and finally restores the stack frame. 
-irq_common_stub:
-   pusha                    ; Pushes edi,esi,ebp,esp,ebx,edx,ecx,eax
+[EXTERN intr_handler]
+; This is our common interrupt stub, for both ISRs and IRQs. It saves the
+; processor state, sets up for kernel mode segments, calls the C-level
+; handler with a pointer to the saved state (struct cpu_regs) and finally
+; restores the (possibly modified) stack frame. %gs is left alone, it always
+; points to the per-CPU data (see cpu.h).
+intr_common_stub:
+    pusha                    ; Pushes edi,esi,ebp,esp,ebx,edx,ecx,eax
 
-   mov ax, ds               ; Lower 16-bits of eax = ds.
-   push eax                 ; save the data segment descriptor
+    mov ax, ds               ; Lower 16-bits of eax = ds.
+    push eax                 ; save the data segment descriptor
 
-   mov ax, 0x10  ; load the kernel data segment descriptor
-   mov ds, ax
-   mov es, ax
-   mov fs, ax
-   mov gs, ax
+    mov ax, 0x10  ; load the kernel data segment descriptor
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
 
-   call irq_handler
+    push esp                 ; struct cpu_regs *
+    call intr_handler
+    add esp, 4
 
-   pop ebx        ; reload the original data segment descriptor
-   mov ds, bx
-   mov es, bx
-   mov fs, bx
-   mov gs, bx
+    pop eax        ; reload the original data segment descriptor
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
 
-   popa                     ; Pops edi,esi,ebp...
-   add esp, 8     ; Cleans up the pushed error code and pushed ISR number
-   sti
-   iret           ; pops 5 things at once: CS, EIP, EFLAGS, SS, and ESP
+    popa                     ; Pops edi,esi,ebp...
+    add esp, 8     ; Cleans up the pushed error code and pushed ISR number
+    iret           ; pops 5 things at once: CS, EIP, EFLAGS, SS, and ESP
@@ -0,0 +1,25 @@
+;
+; switch.s -- task context switch.
+;
+
+; void switch_context(uint32_t *save_esp, uint32_t esp)
+; Push the callee saved registers, store the stack pointer in *save_esp, load
+; esp and pop the registers of the task we switch to. The next ret returns
+; into that task, where it called switch_context() (or to task_entry() for a
+; new one, see task_create()).
+[GLOBAL switch_context]
+
+switch_context:
+    mov eax, [esp+4]  ; where to save our stack pointer.
+    mov edx, [esp+8]  ; the stack pointer of the next task.
+    push ebp
+    push ebx
+    push esi
+    push edi
+    mov [eax], esp
+    mov esp, edx
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
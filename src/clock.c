@@ -0,0 +1,147 @@
+/*
+ * clock.c -- high resolution clock, based on the CPU time-stamp counter.
+ *
+ * The TSC frequency is measured at boot by counting cycles while the PIT
+ * channel 2 counts down a known delay. Cycles are converted into nanoseconds
+ * with a fixed point factor: ns = (cycles * clock_mult) >> CLOCK_SHIFT.
+ */
+#include <common.h>
+#include <clock.h>
+#include <timer.h>
+
+
+#define	CALIBRATE_MS	10 /* length of one calibration run */
+#define	CALIBRATE_RUNS	3
+#define	CPUID_TSC	0x10 /* cpuid(1) %edx bit */
+
+
+static uint32_t	clock_tsc_khz;
+static uint32_t	clock_mult;
+static uint64_t	clock_boot; /* TSC value at init_clock() */
+
+
+static int
+has_tsc(void)
+{
+	uint32_t eax = 1, ebx, ecx, edx;
+
+	asm volatile ("cpuid"
+	    : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+	return ((edx & CPUID_TSC) != 0);
+}
+
+
+/* count the TSC cycles elapsed during CALIBRATE_MS using the PIT. */
+static uint64_t
+calibrate_run(void)
+{
+	uint32_t latch = PIT_FREQ / (1000 / CALIBRATE_MS);
+	uint64_t start, end;
+
+	/* gate channel 2 on, disconnect the speaker. */
+	outb(PIT_GATE, (inb(PIT_GATE) & ~0x2) | 0x1);
+	outb(PIT_CMD, PIT_CH2_ONESHOT);
+	outb(PIT_CH2, latch & 0xFF);
+	outb(PIT_CH2, (latch >> 8) & 0xFF);
+
+	start = clock_cycles();
+	while ((inb(PIT_GATE) & PIT_CH2_OUT) == 0)
+		;
+	end = clock_cycles();
+
+	return (end - start);
+}
+
+
+int
+init_clock(void)
+{
+	uint64_t cycles, best = ~0ULL;
+	int i;
+
+	if (!has_tsc())
+		return (-1);
+
+	/* keep the shortest run, the others have been disturbed. */
+	for (i = 0; i < CALIBRATE_RUNS; i++) {
+		cycles = calibrate_run();
+		if (cycles < best)
+			best = cycles;
+	}
+	clock_tsc_khz = (uint32_t)udivmod64(best, CALIBRATE_MS, NULL);
+	KASSERT("TSC frequency", clock_tsc_khz > 0);
+	clock_mult = (uint32_t)udivmod64(1000000ULL << CLOCK_SHIFT,
+	    clock_tsc_khz, NULL);
+	clock_boot = clock_cycles();
+
+	return (0);
+}
+
+
+uint32_t
+clock_khz(void)
+{
+
+	return (clock_tsc_khz);
+}
+
+
+uint64_t
+clock_cycles2ns(uint64_t cycles)
+{
+	uint32_t lo = cycles, hi = cycles >> 32;
+
+	/* split to avoid overflowing a 64-bits intermediate product. */
+	return ((((uint64_t)lo * clock_mult) >> CLOCK_SHIFT) +
+	    (((uint64_t)hi * clock_mult) << (32 - CLOCK_SHIFT)));
+}
+
+
+uint64_t
+clock_ns(void)
+{
+
+	return (clock_cycles2ns(clock_cycles() - clock_boot));
+}
+
+
+void
+clock_delay_us(uint32_t us)
+{
+	uint64_t end;
+
+	end = clock_cycles() +
+	    udivmod64((uint64_t)us * clock_tsc_khz, 1000, NULL);
+	while (clock_cycles() < end)
+		asm volatile ("pause");
+}
+
+
+void
+clock_stat_add(struct clock_stat *cs, uint64_t cycles)
+{
+
+	cs->cs_count++;
+	cs->cs_cycles += cycles;
+	if (cycles < cs->cs_min)
+		cs->cs_min = cycles;
+	if (cycles > cs->cs_max)
+		cs->cs_max = cycles;
+}
+
+
+void
+clock_stat_print(const struct clock_stat *cs)
+{
+	uint64_t avg = 0;
+
+	if (cs->cs_count == 0) {
+		(void)printf("%s: no sample\n", cs->cs_name);
+		return;
+	}
+	/* cycles sums don't overflow 32-bits counts in practice. */
+	avg = udivmod64(cs->cs_cycles, (uint32_t)cs->cs_count, NULL);
+	(void)printf("%s: %llu samples, avg %lluns, min %lluns, max %lluns\n",
+	    cs->cs_name, cs->cs_count, clock_cycles2ns(avg),
+	    clock_cycles2ns(cs->cs_min), clock_cycles2ns(cs->cs_max));
+}
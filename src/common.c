@@ -4,6 +4,7 @@
  */
 #include <common.h>
 #include <monitor.h>
+#include <klog.h>
 
 
 void
@@ -33,6 +34,40 @@ inw(uint16_t port)
 }
 
 
+uint32_t
+intr_disable(void)
+{
+	uint32_t eflags;
+
+	asm volatile ("pushfl; popl %0; cli" : "=r" (eflags) : : "memory");
+	return (eflags);
+}
+
+
+void
+intr_restore(uint32_t eflags)
+{
+
+	asm volatile ("pushl %0; popfl" : : "r" (eflags) : "memory", "cc");
+}
+
+
+uint64_t
+udivmod64(uint64_t n, uint32_t d, uint32_t *rem)
+{
+	uint32_t hi = n >> 32, lo = n, qhi, qlo, r;
+
+	/* divide the high word first so that divl can't overflow. */
+	qhi = hi / d;
+	hi  = hi % d;
+	asm ("divl %4" : "=a" (qlo), "=d" (r) : "a" (lo), "d" (hi), "rm" (d));
+	if (rem != NULL)
+		*rem = r;
+
+	return (((uint64_t)qhi << 32) | qlo);
+}
+
+
 void *
 memset(void *b, int c, size_t len)
 {
@@ -86,18 +121,31 @@ return (*(const unsigned char *)s1 - *(const unsigned char *)(s2 - 1));
 
 }
 
+int
+memcmp(const void *b1, const void *b2, size_t len)
+{
+	const unsigned char *p1 = b1, *p2 = b2;
+
+	for (; len > 0; len--, p1++, p2++) {
+		if (*p1 != *p2)
+			return (*p1 - *p2);
+	}
+	return (0);
+}
+
 void
 _panic(const char *fmt, ...)
 {
 	va_list ap;
 
-	(void)printf("\n***** Kernel panic! *****\n");
+	(void)klog_printf("\n***** Kernel panic! *****\n");
 
 	va_start(ap, fmt);
-	(void)vprintf(fmt, ap);
+	(void)klog_vprintf(fmt, ap);
 	va_end(ap);
 
-	(void)printf("\n*************************\n");
+	(void)klog_printf("\n*************************\n");
+	klog_panic();
 
 	for (;;)
 		;
@@ -0,0 +1,109 @@
+/*
+ * cpu.c -- per-CPU data and multiprocessor startup.
+ */
+#include <common.h>
+#include <atomic.h>
+#include <cpu.h>
+#include <apic.h>
+#include <clock.h>
+#include <paging.h>
+#include <descriptor_tables.h>
+#include <task.h>
+
+
+#define	AP_START_TIMEOUT	100 /* ms */
+
+/* shared with the trampoline, in asm/ap_boot.s */
+struct ap_boot_args {
+	uint32_t	ab_cr3;
+	uint32_t	ab_stack;
+	uint32_t	ab_entry;
+	uint32_t	ab_cpu;
+};
+
+extern char	ap_trampoline[], ap_trampoline_end[], ap_boot_args[];
+
+/* in paging.c */
+extern struct vm_page_directory *kernel_directory;
+
+
+struct cpu_info	cpus[MAXCPU];
+uint32_t	ncpu = 1;
+
+
+/* C entry point of the application processors. */
+static void
+ap_main(struct cpu_info *ci)
+{
+
+	gdt_init_cpu(ci);
+	idt_load();
+	ci->ci_directory = kernel_directory;
+	lapic_init();
+	task_init_cpu();
+	atomic_store_rel(&ci->ci_started, 1);
+
+	task_idle();
+	/* NOTREACHED */
+}
+
+
+/* start the AP ci, return -1 if it did not show up. */
+static int
+ap_start(struct cpu_info *ci)
+{
+	struct ap_boot_args *args;
+	int ms;
+
+	args = (struct ap_boot_args *)(AP_BOOT_ADDR +
+	    (ap_boot_args - ap_trampoline));
+	args->ab_cr3   = (uint32_t)&kernel_directory->pd_tblphys;
+	args->ab_stack = (uint32_t)ci->ci_stack + CPU_STACKSIZ;
+	args->ab_entry = (uint32_t)&ap_main;
+	args->ab_cpu   = (uint32_t)ci;
+
+	lapic_start_ap(ci->ci_apic_id, AP_BOOT_ADDR);
+	for (ms = 0; ms < AP_START_TIMEOUT; ms++) {
+		if (atomic_load_acq(&ci->ci_started))
+			return (0);
+		clock_delay_us(1000);
+	}
+	return (-1);
+}
+
+
+uint32_t
+smp_start(void)
+{
+	struct cpu_info *ci;
+	struct mp_cpu *mc;
+	uint32_t i;
+
+	cpus[0].ci_apic_id = lapic_id();
+	cpus[0].ci_started = 1;
+	if (!lapic_present() || clock_khz() == 0)
+		return (ncpu);
+
+	(void)memcpy((void *)AP_BOOT_ADDR, ap_trampoline,
+	    ap_trampoline_end - ap_trampoline);
+
+	for (i = 0; i < mp_config.mp_ncpu && ncpu < MAXCPU; i++) {
+		mc = &mp_config.mp_cpus[i];
+		if (mc->mc_apic_id == cpus[0].ci_apic_id)
+			continue;
+		ci = &cpus[ncpu];
+		ci->ci_id = ncpu;
+		ci->ci_apic_id = mc->mc_apic_id;
+		ci->ci_stack = kmalloc(CPU_STACKSIZ);
+		if (ap_start(ci) == -1) {
+			(void)printf("cpu%u (APIC %u) did not start\n",
+			    ci->ci_id, ci->ci_apic_id);
+			kfree(ci->ci_stack);
+			bzero(ci, sizeof(struct cpu_info));
+			continue;
+		}
+		ncpu++;
+	}
+
+	return (ncpu);
+}
@@ -6,19 +6,17 @@
  */
 #include <common.h>
 #include <descriptor_tables.h>
+#include <cpu.h>
 
 extern void	gdt_flush(uint32_t gdt_p);
-static void	init_gdt(void);
-static void	gdt_set_gate(uint32_t n, uint32_t base, uint32_t limit,
-		    uint8_t access, uint8_t gran);
+static void	gdt_set_gate(struct gdt_entry *gdt, uint32_t n, uint32_t base,
+		    uint32_t limit, uint8_t access, uint8_t gran);
 
 extern void	idt_flush(uint32_t idt_p);
 static void	init_idt(void);
 static void	idt_set_gate(uint32_t n, uint32_t base, uint16_t sel,
 		    uint8_t flags);
 
-static struct gdt_entry		gdt_entries[5];
-static struct gdt_ptr		gdt_ptr;
 static struct idt_entry		idt_entries[256];
 static struct idt_ptr		idt_ptr;
 
@@ -31,24 +29,31 @@ void
 init_descriptor_tables(void)
 {
 
-	init_gdt();
+	gdt_init_cpu(&cpus[0]);
 	init_idt();
 }
 
 
-static void
-init_gdt(void)
+void
+gdt_init_cpu(struct cpu_info *ci)
 {
-	gdt_ptr.gp_limit = sizeof(gdt_entries) - 1;
-	gdt_ptr.gp_base  = (uint32_t)&gdt_entries;
-
-	gdt_set_gate(0, 0, 0, 0, 0);                /* Null segment */
-	gdt_set_gate(1, 0, 0xFFFFFFFF, 0x9A, 0xCF); /* Code segment */
-	gdt_set_gate(2, 0, 0xFFFFFFFF, 0x92, 0xCF); /* Data segment */
-	gdt_set_gate(3, 0, 0xFFFFFFFF, 0xFA, 0xCF); /* User mode code segment */
-	gdt_set_gate(4, 0, 0xFFFFFFFF, 0xF2, 0xCF); /* User mode data segment */
-
-	gdt_flush((uint32_t)&gdt_ptr);
+	struct gdt_entry *gdt = ci->ci_gdt;
+
+	ci->ci_self = ci;
+	ci->ci_gdt_ptr.gp_limit = sizeof(ci->ci_gdt) - 1;
+	ci->ci_gdt_ptr.gp_base  = (uint32_t)gdt;
+
+	gdt_set_gate(gdt, 0, 0, 0, 0, 0);                /* Null segment */
+	gdt_set_gate(gdt, 1, 0, 0xFFFFFFFF, 0x9A, 0xCF); /* Code segment */
+	gdt_set_gate(gdt, 2, 0, 0xFFFFFFFF, 0x92, 0xCF); /* Data segment */
+	gdt_set_gate(gdt, 3, 0, 0xFFFFFFFF, 0xFA, 0xCF); /* User mode code segment */
+	gdt_set_gate(gdt, 4, 0, 0xFFFFFFFF, 0xF2, 0xCF); /* User mode data segment */
+	/* per-CPU data segment */
+	gdt_set_gate(gdt, 5, (uint32_t)ci, sizeof(struct cpu_info) - 1, 0x92,
+	    0x40);
+
+	gdt_flush((uint32_t)&ci->ci_gdt_ptr);
+	asm volatile ("movw %w0, %%gs" : : "r" (GSEL_CPU));
 }
 
 
@@ -56,21 +61,21 @@ init_gdt(void)
  * Set the value of one GDT entry.
  */
 static void
-gdt_set_gate(uint32_t n, uint32_t base, uint32_t limit, uint8_t access,
-    uint8_t gran)
+gdt_set_gate(struct gdt_entry *gdt, uint32_t n, uint32_t base, uint32_t limit,
+    uint8_t access, uint8_t gran)
 {
-	if (n >= NELEM(gdt_entries))
+	if (n >= NGDT)
 		PANIC("bad gdt_entries index");
 
-	gdt_entries[n].ge_base_lo = (base & 0xFFFF);
-	gdt_entries[n].ge_base_mi = (base >> 16) & 0xFF;
-	gdt_entries[n].ge_base_hi = (base >> 24) & 0xFF;
+	gdt[n].ge_base_lo = (base & 0xFFFF);
+	gdt[n].ge_base_mi = (base >> 16) & 0xFF;
+	gdt[n].ge_base_hi = (base >> 24) & 0xFF;
 
-	gdt_entries[n].ge_limit_lo    = (limit & 0xFFFF);
-	gdt_entries[n].ge_granularity = (limit >> 16) & 0x0F;
+	gdt[n].ge_limit_lo    = (limit & 0xFFFF);
+	gdt[n].ge_granularity = (limit >> 16) & 0x0F;
 
-	gdt_entries[n].ge_granularity |= gran & 0xF0;
-	gdt_entries[n].ge_access       = access;
+	gdt[n].ge_granularity |= gran & 0xF0;
+	gdt[n].ge_access       = access;
 }
 
 
@@ -142,6 +147,31 @@ init_idt(void)
 	idt_set_gate(45, (uint32_t)irq13, 0x08, 0x8E);
 	idt_set_gate(46, (uint32_t)irq14, 0x08, 0x8E);
 	idt_set_gate(47, (uint32_t)irq15, 0x08, 0x8E);
+	idt_set_gate(48, (uint32_t)irq16, 0x08, 0x8E);
+	idt_set_gate(49, (uint32_t)irq17, 0x08, 0x8E);
+	idt_set_gate(50, (uint32_t)irq18, 0x08, 0x8E);
+	idt_set_gate(51, (uint32_t)irq19, 0x08, 0x8E);
+	idt_set_gate(52, (uint32_t)irq20, 0x08, 0x8E);
+	idt_set_gate(53, (uint32_t)irq21, 0x08, 0x8E);
+	idt_set_gate(54, (uint32_t)irq22, 0x08, 0x8E);
+	idt_set_gate(55, (uint32_t)irq23, 0x08, 0x8E);
+	idt_set_gate(56, (uint32_t)irq24, 0x08, 0x8E);
+	idt_set_gate(57, (uint32_t)irq25, 0x08, 0x8E);
+	idt_set_gate(58, (uint32_t)irq26, 0x08, 0x8E);
+	idt_set_gate(59, (uint32_t)irq27, 0x08, 0x8E);
+	idt_set_gate(60, (uint32_t)irq28, 0x08, 0x8E);
+	idt_set_gate(61, (uint32_t)irq29, 0x08, 0x8E);
+	idt_set_gate(62, (uint32_t)irq30, 0x08, 0x8E);
+	idt_set_gate(63, (uint32_t)irq31, 0x08, 0x8E);
+	idt_set_gate(255, (uint32_t)isr_spurious, 0x08, 0x8E);
+
+	idt_load();
+}
+
+
+void
+idt_load(void)
+{
 
 	idt_flush((uint32_t)&idt_ptr);
 }
@@ -0,0 +1,59 @@
+/*
+ * devfs.c -- a flat filesystem exporting the kernel devices.
+ *
+ * Drivers own their vfs_node and register it here, devfs only indexes them.
+ */
+#include <devfs.h>
+
+
+static struct vfs_node	 devfs_root;
+static struct vfs_node	*devfs_nodes[DEVFS_MAXDEV];
+static size_t		 ndevfs_nodes;
+static struct vfs_dirhash	devfs_names;
+
+
+/* the cookie is the index of the next device. */
+static int
+devfs_readdir(struct vfs_node *node, uint32_t *cookie, struct dirent *buf,
+    uint32_t n)
+{
+	struct vfs_node *dev;
+	uint32_t i;
+
+	for (i = 0; i < n && *cookie < ndevfs_nodes; i++) {
+		dev = devfs_nodes[(*cookie)++];
+		vfs_dirent(&buf[i], dev->name, dev->inode);
+	}
+	return (i);
+}
+
+
+struct vfs_node *
+init_devfs(void)
+{
+
+	bzero(&devfs_root, sizeof(devfs_root));
+	(void)memcpy(devfs_root.name, "dev", 4);
+	devfs_root.flags   = VFS_DIRECTORY;
+	devfs_root.readdir = &devfs_readdir;
+	devfs_root.finddir = &vfs_dirhash_finddir;
+	devfs_root.impl    = (uint32_t)&devfs_names;
+	if (vfs_dirhash_init(&devfs_names, DEVFS_MAXDEV) == -1)
+		PANIC("devfs: out of memory");
+
+	return (&devfs_root);
+}
+
+
+int
+devfs_register(struct vfs_node *node)
+{
+
+	if (ndevfs_nodes >= NELEM(devfs_nodes) ||
+	    vfs_dirhash_insert(&devfs_names, node) == -1)
+		return (-1);
+	node->inode = ndevfs_nodes;
+	devfs_nodes[ndevfs_nodes++] = node;
+	vfs_cache_purge(&devfs_root);
+	return (0);
+}
@@ -0,0 +1,199 @@
+/*
+ * file.c -- open files and file descriptors.
+ *
+ * A descriptor table belongs to its task and is only used by it, it needs no
+ * lock. Files are not locked either: they can only be shared by the
+ * descriptors of one task.
+ */
+#include <file.h>
+#include <task.h>
+#include <atomic.h>
+
+
+/* the file open as fd in the current task, or NULL. */
+static struct file *
+fd_get(int fd)
+{
+	struct task *t = curtask();
+
+	if (t == NULL || fd < 0 || fd >= TASK_NFILES)
+		return (NULL);
+	return (t->t_files[fd]);
+}
+
+/* put fp in the lowest free slot of the current task, return it or -1. */
+static int
+fd_alloc(struct file *fp)
+{
+	struct task *t = curtask();
+	int fd;
+
+	if (t == NULL)
+		return (-1);
+	for (fd = 0; fd < TASK_NFILES; fd++) {
+		if (t->t_files[fd] == NULL) {
+			t->t_files[fd] = fp;
+			return (fd);
+		}
+	}
+	return (-1);
+}
+
+
+struct file *
+file_hold(struct file *fp)
+{
+
+	(void)atomic_fetchadd(&fp->f_count, 1);
+	return (fp);
+}
+
+void
+file_drop(struct file *fp)
+{
+
+	if (atomic_fetchadd(&fp->f_count, -1) != 1)
+		return;
+	vfs_close(fp->f_node);
+	kfree(fp);
+}
+
+
+int
+fd_open(struct vfs_node *node, int flags)
+{
+	struct file *fp;
+	int fd;
+
+	if ((flags & O_ACCMODE) == O_ACCMODE)
+		return (-1);
+	if ((node->flags & VFS_MOUNTPOINT) && node->ptr != NULL)
+		node = node->ptr;
+	if ((fp = kmalloc0(sizeof(struct file))) == NULL)
+		return (-1);
+	fp->f_node  = node;
+	fp->f_flags = (flags & O_APPEND) | ((flags & O_ACCMODE) + 1);
+	fp->f_count = 1;
+	if ((fd = fd_alloc(fp)) == -1) {
+		kfree(fp);
+		return (-1);
+	}
+	if (vfs_open(node, flags) != 0) {
+		curtask()->t_files[fd] = NULL;
+		kfree(fp);
+		return (-1);
+	}
+	return (fd);
+}
+
+int
+fd_close(int fd)
+{
+	struct file *fp;
+
+	if ((fp = fd_get(fd)) == NULL)
+		return (-1);
+	curtask()->t_files[fd] = NULL;
+	file_drop(fp);
+	return (0);
+}
+
+int
+fd_dup(int fd)
+{
+	struct file *fp;
+	int nfd;
+
+	if ((fp = fd_get(fd)) == NULL)
+		return (-1);
+	if ((nfd = fd_alloc(fp)) != -1)
+		(void)file_hold(fp);
+	return (nfd);
+}
+
+int32_t
+fd_read(int fd, void *buf, uint32_t len)
+{
+	struct file *fp;
+	const void *addr;
+	uint32_t n;
+
+	if ((fp = fd_get(fd)) == NULL || !(fp->f_flags & FREAD))
+		return (-1);
+
+	/*
+	 * Look up the bytes once, and then read them without the filesystem.
+	 * Not when writing, the filesystem may keep its bytes elsewhere.
+	 */
+	if (!(fp->f_flags & (FMAPPED | FWRITE))) {
+		fp->f_flags |= FMAPPED;
+		if (vfs_map(fp->f_node, 0, &addr, &fp->f_datalen) == 0)
+			fp->f_data = addr;
+	}
+	if (fp->f_data != NULL) {
+		if (fp->f_offset >= fp->f_datalen)
+			return (0);
+		n = fp->f_datalen - fp->f_offset;
+		if (n > len)
+			n = len;
+		(void)memcpy(buf, fp->f_data + fp->f_offset, n);
+	} else
+		n = vfs_read(fp->f_node, fp->f_offset, len, buf);
+	fp->f_offset += n;
+	return (n);
+}
+
+int32_t
+fd_write(int fd, const void *buf, uint32_t len)
+{
+	struct file *fp;
+	uint32_t n;
+
+	if ((fp = fd_get(fd)) == NULL || !(fp->f_flags & FWRITE))
+		return (-1);
+	if (fp->f_flags & FAPPEND)
+		fp->f_offset = fp->f_node->length;
+	n = vfs_write(fp->f_node, fp->f_offset, len, (char *)buf);
+	fp->f_offset += n;
+	return (n);
+}
+
+int32_t
+fd_seek(int fd, int32_t offset, int whence)
+{
+	struct file *fp;
+	int32_t base;
+
+	if ((fp = fd_get(fd)) == NULL)
+		return (-1);
+	switch (whence) {
+	case SEEK_SET:
+		base = 0;
+		break;
+	case SEEK_CUR:
+		base = fp->f_offset;
+		break;
+	case SEEK_END:
+		base = fp->f_node->length;
+		break;
+	default:
+		return (-1);
+	}
+	if (base + offset < 0)
+		return (-1);
+	fp->f_offset = base + offset;
+	return (fp->f_offset);
+}
+
+void
+fd_closeall(struct task *t)
+{
+	int fd;
+
+	for (fd = 0; fd < TASK_NFILES; fd++) {
+		if (t->t_files[fd] != NULL) {
+			file_drop(t->t_files[fd]);
+			t->t_files[fd] = NULL;
+		}
+	}
+}
@@ -18,29 +18,56 @@
  */
 #include <stdarg.h>
 
-#include <monitor.h>
+#include <common.h>
+#include <klog.h>
+#include <softirq.h>
 
 
 int
-vprintf(const char *fmt, va_list ap)
+kvprintf(const char *fmt, void (*func)(int, void *), void *arg, va_list ap)
 {
 	const char *hex = "0123456789abcdef";
-	char buf[11];
+	char buf[21];
 	char *s;
 	unsigned u;
-	int ret = 0, i, c;
+	uint64_t uq;
+	uint32_t r;
+	int ret = 0, i, c, width, ladjust;
+	char padc;
 
 	while ((c = *fmt++)) {
 		if (c == '%') {
+			/* flags and field width */
+			ladjust = width = 0;
+			padc = ' ';
+			for (; *fmt == '-' || *fmt == '0'; fmt++) {
+				if (*fmt == '-')
+					ladjust = 1;
+				else
+					padc = '0';
+			}
+			for (; *fmt >= '0' && *fmt <= '9'; fmt++)
+				width = width * 10 + (*fmt - '0');
 			c = *fmt++;
 			switch (c) {
 			case 'c':
-				mon_putchar(va_arg(ap, int));
+				func(va_arg(ap, int), arg);
 				ret++;
 				continue;
 			case 's':
-				for (s = va_arg(ap, char *); *s; s++) {
-					mon_putchar(*s);
+				s = va_arg(ap, char *);
+				for (i = 0; s[i]; i++)
+					;
+				for (width -= i; !ladjust && width > 0; width--) {
+					func(' ', arg);
+					ret++;
+				}
+				for (; *s; s++) {
+					func(*s, arg);
+					ret++;
+				}
+				for (; width > 0; width--) {
+					func(' ', arg);
 					ret++;
 				}
 				continue;
@@ -61,6 +88,23 @@ vprintf(const char *fmt, va_list ap)
 					*s++ = '0' + u % 10U;
 				} while (u /= 10U);
 				goto dumpbuf;
+			case 'l':
+				/* only %llu and %llx, for uint64_t */
+				if (*fmt == 'l')
+					fmt++;
+				c = *fmt++;
+				uq = va_arg(ap, uint64_t);
+				s = buf;
+				do {
+					if (c == 'x') {
+						*s++ = hex[uq & 0xfu];
+						uq >>= 4;
+					} else {
+						uq = udivmod64(uq, 10U, &r);
+						*s++ = '0' + r;
+					}
+				} while (uq != 0);
+				goto dumpbuf;
 			case 'x':
 				u = va_arg(ap, unsigned);
 				s = buf;
@@ -68,14 +112,23 @@ vprintf(const char *fmt, va_list ap)
 					*s++ = hex[u & 0xfu];
 				} while (u >>= 4);
 			dumpbuf:
+				for (width -= s - buf; !ladjust && width > 0;
+				    width--) {
+					func(padc, arg);
+					ret++;
+				}
 				while (--s >= buf) {
-					mon_putchar(*s);
+					func(*s, arg);
+					ret++;
+				}
+				for (; width > 0; width--) {
+					func(' ', arg);
 					ret++;
 				}
 				continue;
 			}
 		}
-		mon_putchar(c);
+		func(c, arg);
 		ret++;
 	}
 
@@ -83,6 +136,72 @@ vprintf(const char *fmt, va_list ap)
 }
 
 
+/* snprintf() output state */
+struct snprintf_arg {
+	char	*str;
+	size_t	 remain;
+};
+
+
+static void
+snprintf_func(int c, void *arg)
+{
+	struct snprintf_arg *info = arg;
+
+	if (info->remain >= 2) {
+		*info->str++ = c;
+		info->remain--;
+	}
+}
+
+
+int
+vsnprintf(char *str, size_t size, const char *fmt, va_list ap)
+{
+	struct snprintf_arg info;
+	int ret;
+
+	info.str = str;
+	info.remain = size;
+	ret = kvprintf(fmt, &snprintf_func, &info, ap);
+	if (info.remain >= 1)
+		*info.str++ = '\0';
+
+	return (ret);
+}
+
+
+int
+snprintf(char *str, size_t size, const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	va_start(ap, fmt);
+	ret = vsnprintf(str, size, fmt, ap);
+	va_end(ap);
+
+	return (ret);
+}
+
+
+/*
+ * Our printf() only append to the kernel message buffer, the console is then
+ * fed by klog_drain() from the softirq, so no caller waits for it. Only a
+ * panic drains at once, see klog_panic().
+ */
+int
+vprintf(const char *fmt, va_list ap)
+{
+	int ret;
+
+	ret = klog_vprintf(fmt, ap);
+	raise_softirq(SOFTIRQ_KLOG);
+
+	return (ret);
+}
+
+
 int
 printf(const char *fmt,...)
 {
@@ -8,6 +8,7 @@
 
 /* the kernel's heap */
 struct vm_heap *kernel_heap;
+struct mcs_lock kernel_heap_lock = MCS_LOCK_INITIALIZER("kheap");
 
 /* in paging.c */
 extern struct vm_page_directory *kernel_directory;
@@ -274,6 +275,18 @@ alloc(uint32_t size, int page_align, struct vm_heap *heap)
 }
 
 
+size_t
+alloc_size(void *p)
+{
+	struct vm_heap_header *header = (struct vm_heap_header *)((uint32_t)p -
+	    sizeof(struct vm_heap_header));
+
+	KASSERT("header magic match", header->hh_magic == VM_HEAP_HDR_MAGIC);
+	return (header->hh_size - sizeof(struct vm_heap_header) -
+	    sizeof(struct vm_heap_footer));
+}
+
+
 void
 free(void *p, struct vm_heap *heap)
 {
@@ -2,6 +2,7 @@
 #define __ATTRIBUTES___H
 
 #define __packed	__attribute__((__packed__))
+#define __dead2		__attribute__((__noreturn__))
 
 #endif /* ndef __ATTRIBUTES___H */
 
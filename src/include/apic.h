@@ -0,0 +1,55 @@
+#ifndef APIC_H
+#define APIC_H
+/*
+ * apic.h -- local APIC and I/O APIC support.
+ *
+ * The local APIC of each CPU receives the interrupts, has its own timer and
+ * is acknowledged through a memory-mapped register. I/O APICs replace the
+ * 8259 PICs for the external IRQs, with 24 inputs each.
+ */
+#include <common.h>
+
+#define	LAPIC_SPURIOUS	0xFF /* spurious interrupt vector, see isr_spurious */
+
+/*
+ * Look for the APICs in the MP tables, map their registers and route the ISA
+ * IRQs through the I/O APIC instead of the 8259 PICs, which are masked. It
+ * also measures the local APIC timer frequency using the PIT channel 2, so it
+ * must be called before init_timer(), with interrupts disabled. Return -1
+ * without APIC, leaving the 8259 PICs in charge.
+ */
+int		init_apic(void);
+
+/* enable the local APIC of the calling CPU. */
+void		lapic_init(void);
+int		lapic_present(void); /* has init_apic() succeeded? */
+uint32_t	lapic_id(void);
+void		lapic_eoi(void);
+
+/* send an interrupt on vector to the CPU with the local APIC ID dest. */
+void		lapic_ipi(uint32_t dest, uint32_t vector);
+
+/*
+ * Send the INIT-SIPI-SIPI sequence starting the application processor with
+ * the local APIC ID dest in real mode at addr (page aligned, below 1MB).
+ */
+void		lapic_start_ap(uint32_t dest, uint32_t addr);
+
+/*
+ * Route the external interrupt irq to vector on the CPU with the local APIC
+ * ID dest. ISA IRQs (irq < 16) follow the MP tables wiring, others are inputs
+ * of the first I/O APIC.
+ */
+void		ioapic_route(uint32_t irq, uint32_t vector, uint32_t dest,
+		    int masked);
+void		ioapic_mask(uint32_t irq, int masked);
+
+/*
+ * The local APIC timer, counting down at lapic_timer_khz() (0 without local
+ * APIC) and raising vector when it reaches 0.
+ */
+uint32_t	lapic_timer_khz(void);
+void		lapic_timer_periodic(uint32_t vector, uint32_t count);
+void		lapic_timer_oneshot(uint32_t vector, uint32_t count);
+
+#endif /* ndef APIC_H */
@@ -0,0 +1,74 @@
+#ifndef ATOMIC_H
+#define ATOMIC_H
+/*
+ * atomic.h -- atomic operations on 32-bits words.
+ *
+ * The API loosely follows FreeBSD's atomic(9).
+ */
+#include <types.h>
+
+/* compiler barrier, x86 does not reorder stores with other stores. */
+#define	barrier()	asm volatile ("" : : : "memory")
+
+
+/* atomically add v to *p, return the previous value of *p. */
+static inline uint32_t
+atomic_fetchadd(volatile uint32_t *p, uint32_t v)
+{
+
+	asm volatile ("lock xaddl %0, %1"
+	    : "+r" (v), "+m" (*p)
+	    :
+	    : "memory", "cc");
+	return (v);
+}
+
+
+/* atomically set *p to v, return the previous value of *p. */
+static inline uint32_t
+atomic_swap(volatile uint32_t *p, uint32_t v)
+{
+
+	/* xchg with a memory operand is implicitly locked. */
+	asm volatile ("xchgl %0, %1"
+	    : "+r" (v), "+m" (*p)
+	    :
+	    : "memory");
+	return (v);
+}
+
+
+/* if *p == old set it to new and return non-zero, otherwise return 0. */
+static inline int
+atomic_cmpset(volatile uint32_t *p, uint32_t old, uint32_t new)
+{
+	uint8_t ret;
+
+	asm volatile ("lock cmpxchgl %3, %1\n\t"
+	    "sete %0"
+	    : "=q" (ret), "+m" (*p), "+a" (old)
+	    : "r" (new)
+	    : "memory", "cc");
+	return (ret);
+}
+
+
+static inline uint32_t
+atomic_load_acq(volatile uint32_t *p)
+{
+	uint32_t v = *p;
+
+	barrier();
+	return (v);
+}
+
+
+static inline void
+atomic_store_rel(volatile uint32_t *p, uint32_t v)
+{
+
+	barrier();
+	*p = v;
+}
+
+#endif /* ndef ATOMIC_H */
@@ -0,0 +1,59 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+/*
+ * clock.h -- high resolution clock, based on the CPU time-stamp counter.
+ */
+#include <common.h>
+
+/* precision of the cycles to nanoseconds conversion factor */
+#define	CLOCK_SHIFT	22
+
+/*
+ * Accumulated measures of an interval, see CLOCK_MEASURE_BEGIN() and
+ * CLOCK_MEASURE_END().
+ */
+struct clock_stat {
+	const char	*cs_name;
+	uint64_t	 cs_count;  /* number of samples */
+	uint64_t	 cs_cycles; /* sum of the samples */
+	uint64_t	 cs_min;
+	uint64_t	 cs_max;
+};
+#define	CLOCK_STAT_INITIALIZER(name)	{ (name), 0, 0, ~0ULL, 0 }
+
+/*
+ * Measure the cycles spent between the two macros into the clock_stat s:
+ *
+ *	CLOCK_MEASURE_BEGIN(t);
+ *	do_something();
+ *	CLOCK_MEASURE_END(&something_stat, t);
+ */
+#define	CLOCK_MEASURE_BEGIN(t)	uint64_t t = clock_cycles()
+#define	CLOCK_MEASURE_END(s, t)	clock_stat_add((s), clock_cycles() - (t))
+
+
+/*
+ * Calibrate the TSC against the PIT channel 2. Must be called before the
+ * timer use the channel 2 (see init_timer()). Return -1 without TSC.
+ */
+int	init_clock(void);
+
+/* read the time-stamp counter. */
+static inline uint64_t
+clock_cycles(void)
+{
+	uint32_t lo, hi;
+
+	asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+	return (((uint64_t)hi << 32) | lo);
+}
+
+uint32_t	clock_khz(void); /* TSC frequency */
+uint64_t	clock_cycles2ns(uint64_t cycles);
+uint64_t	clock_ns(void); /* nanoseconds elapsed since init_clock() */
+void		clock_delay_us(uint32_t us); /* busy wait */
+
+void	clock_stat_add(struct clock_stat *cs, uint64_t cycles);
+void	clock_stat_print(const struct clock_stat *cs);
+
+#endif /* ndef CLOCK_H */
@@ -14,9 +14,12 @@ void		outb(uint16_t port, uint8_t value); /* write a byte out to port */
 uint8_t		inb(uint16_t port); /* read a byte out from port */
 uint16_t	inw(uint16_t port); /* read two bytes out from port */
 
+uint32_t	intr_disable(void); /* cli, return the previous eflags */
+void		intr_restore(uint32_t eflags); /* restore intr_disable() eflags */
+
 
 #define PANIC(s, ...)	_panic("%s:%u in %s: " s, __FILE__, __LINE__, __func__, ##__VA_ARGS__)
-void	_panic(const char *fmt, ...);
+void	_panic(const char *fmt, ...) __dead2;
 
 #define KASSERT(msg, cond) (                                       \
 		(cond) ?                                           \
@@ -24,11 +27,18 @@ void	_panic(const char *fmt, ...);
 		PANIC("assertion failed: %s (%s)", (msg), (#cond)) \
 )
 
+/*
+ * 64-bits by 32-bits division, gcc would need libgcc's __udivdi3 for it. The
+ * remainder is stored in *rem unless rem is NULL.
+ */
+uint64_t	udivmod64(uint64_t n, uint32_t d, uint32_t *rem);
+
 void *	memset(void *b, int c, size_t len);
 void	bzero(void *b, size_t len);
 void *	memcpy(void *dest, const void *src, size_t count);
 size_t	strlen(const char *s);
 int	strcmp(const char *s1, const char *s2);
+int	memcmp(const void *b1, const void *b2, size_t len);
 
 
 #include <kmalloc.h>
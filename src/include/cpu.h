@@ -0,0 +1,70 @@
+#ifndef CPU_H
+#define CPU_H
+/*
+ * cpu.h -- per-CPU data and multiprocessor startup.
+ *
+ * Each CPU has its own struct cpu_info, reached through the %gs segment whose
+ * base is set to it in the CPU GDT (see gdt_init_cpu()). The interrupt stubs
+ * never reload %gs.
+ */
+#include <common.h>
+#include <mptable.h>
+#include <descriptor_tables.h>
+#include <tasklet.h>
+
+#define	MAXCPU		MP_MAXCPU
+#define	CPU_STACKSIZ	0x4000 /* kernel stack of the application processors */
+#define	AP_BOOT_ADDR	0x8000 /* where the AP trampoline is copied, it must
+				  be below 1MB and page aligned */
+
+struct vm_page_directory;
+struct task;
+
+struct cpu_info {
+	struct cpu_info		*ci_self;   /* %gs:0, see curcpu() */
+	uint32_t		 ci_id;     /* index in cpus */
+	uint32_t		 ci_apic_id;
+	volatile uint32_t	 ci_started;
+	void			*ci_stack;
+	struct gdt_entry	 ci_gdt[NGDT];
+	struct gdt_ptr		 ci_gdt_ptr;
+	struct vm_page_directory	*ci_directory; /* loaded in CR3 */
+
+	/* softirq.c */
+	volatile uint32_t	 ci_softirq_pending;
+	volatile uint32_t	 ci_irq_nesting; /* hardware interrupts depth */
+	volatile int		 ci_softirq_running;
+
+	/* tasklet.c */
+	struct tasklet * volatile	ci_tasklets;
+
+	/* task.c */
+	struct task		*ci_curtask;
+	struct task		*ci_idle;
+	struct task		*ci_zombie; /* exited, freed by the next task */
+	volatile int		 ci_need_resched;
+};
+
+extern struct cpu_info	cpus[MAXCPU];
+extern uint32_t		ncpu; /* number of running CPUs */
+
+
+static inline struct cpu_info *
+curcpu(void)
+{
+	struct cpu_info *ci;
+
+	asm volatile ("movl %%gs:0, %0" : "=r" (ci));
+	return (ci);
+}
+
+
+/*
+ * Start the application processors found in the MP tables, with an
+ * INIT-SIPI-SIPI sequence. They run their idle task, see task_idle(). Needs
+ * the APIC (see init_apic()) and the TSC clock. Return the number of running
+ * CPUs.
+ */
+uint32_t	smp_start(void);
+
+#endif /* ndef CPU_H */
@@ -3,6 +3,13 @@
 
 #include <common.h>
 
+#define	NGDT		6    /* entries in each CPU GDT */
+#define	GSEL_KCODE	0x08
+#define	GSEL_KDATA	0x10
+#define	GSEL_CPU	0x28 /* the CPU struct cpu_info, loaded in %gs */
+
+struct cpu_info;
+
 /*
  * This structure contains the value of one GDT entry. We use the attribute
  * 'packed' to tell the compiler not to change any of the alignment in the
@@ -42,8 +49,15 @@ struct idt_ptr
 } __packed;
 
 
+/* set up the boot CPU GDT and the IDT. */
 void	init_descriptor_tables(void);
 
+/* build and load the GDT of ci, then point %gs to ci. */
+void	gdt_init_cpu(struct cpu_info *ci);
+
+/* load the IDT, it is shared by every CPU. */
+void	idt_load(void);
+
 
 /* These extern directives let us access the addresses of our ASM ISR
    handlers. */
@@ -95,5 +109,22 @@ extern void irq12(void);
 extern void irq13(void);
 extern void irq14(void);
 extern void irq15(void);
+extern void irq16(void);
+extern void irq17(void);
+extern void irq18(void);
+extern void irq19(void);
+extern void irq20(void);
+extern void irq21(void);
+extern void irq22(void);
+extern void irq23(void);
+extern void irq24(void);
+extern void irq25(void);
+extern void irq26(void);
+extern void irq27(void);
+extern void irq28(void);
+extern void irq29(void);
+extern void irq30(void);
+extern void irq31(void);
+extern void isr_spurious(void);
 
 #endif /* ndef DESCRIPTOR_TABLES_H */
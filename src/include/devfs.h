@@ -0,0 +1,17 @@
+#ifndef DEVFS_H
+#define DEVFS_H
+/*
+ * devfs.h -- a flat filesystem exporting the kernel devices.
+ */
+#include <common.h>
+#include <vfs.h>
+
+#define	DEVFS_MAXDEV	16
+
+/* Initialise devfs, returns its root directory node. */
+struct vfs_node	*init_devfs(void);
+
+/* Make node available as /dev/<node->name>. Return -1 when full. */
+int	devfs_register(struct vfs_node *node);
+
+#endif /* ndef DEVFS_H */
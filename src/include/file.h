@@ -0,0 +1,71 @@
+#ifndef FILE_H
+#define FILE_H
+/*
+ * file.h -- open files and file descriptors.
+ *
+ * An open file is a vfs_node with the current offset and the open flags.
+ * Files are reference counted: descriptors made by fd_dup() share the file,
+ * and so its offset. Descriptors index the table of the current task, see
+ * struct task.
+ */
+#include <common.h>
+#include <vfs.h>
+
+/* fd_open() flags */
+#define	O_RDONLY	0x0000
+#define	O_WRONLY	0x0001
+#define	O_RDWR		0x0002
+#define	O_ACCMODE	0x0003
+#define	O_APPEND	0x0008 /* writes go to the end of the file */
+
+/* f_flags values */
+#define	FREAD		0x0001
+#define	FWRITE		0x0002
+#define	FAPPEND		O_APPEND
+#define	FMAPPED		0x0100 /* f_data has been looked up */
+
+/* fd_seek() whence */
+#define	SEEK_SET	0
+#define	SEEK_CUR	1
+#define	SEEK_END	2
+
+struct task;
+
+struct file {
+	struct vfs_node		*f_node;   /* mountpoints resolved */
+	uint32_t		 f_offset;
+	int			 f_flags;
+	volatile uint32_t	 f_count;  /* references */
+	const char		*f_data;   /* the file bytes if mappable, see
+					      vfs_map() */
+	uint32_t		 f_datalen;
+};
+
+
+/* take a reference on fp. */
+struct file	*file_hold(struct file *fp);
+/* release a reference on fp, closing it with the last one. */
+void	file_drop(struct file *fp);
+
+/*
+ * Open node and return the lowest free descriptor of the current task, or
+ * -1 if out of descriptors or memory, if flags are bad or if the filesystem
+ * fails the open.
+ */
+int	fd_open(struct vfs_node *node, int flags);
+/* close fd, return -1 if it is not open. */
+int	fd_close(int fd);
+/* return a new descriptor for the file of fd, or -1. */
+int	fd_dup(int fd);
+/*
+ * Read or write from the file offset on and move it past the bytes done.
+ * Return their count, or -1 if fd is not open for it.
+ */
+int32_t	fd_read(int fd, void *buf, uint32_t len);
+int32_t	fd_write(int fd, const void *buf, uint32_t len);
+/* move the file offset of fd, return it or -1. */
+int32_t	fd_seek(int fd, int32_t offset, int whence);
+/* close all the descriptors of t, see task_exit(). */
+void	fd_closeall(struct task *t);
+
+#endif /* ndef FILE_H */
@@ -8,7 +8,11 @@
 #include <stdarg.h>
 #include <sys/queue.h>
 
+int	kvprintf(const char *fmt, void (*func)(int, void *), void *arg,
+	    va_list ap);
 int	printf(const char *fmt, ...);
+int	snprintf(char *str, size_t size, const char *fmt, ...);
+int	vsnprintf(char *str, size_t size, const char *fmt, va_list ap);
 int	vprintf(const char *fmt, va_list ap);
 
 #endif /* ndef FREEBSD_H */
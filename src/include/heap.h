@@ -7,6 +7,7 @@
 //
 #include <common.h>
 #include <sorted_array.h>
+#include <mcslock.h>
 
 #define	VM_KERN_HEAP_START		0xC0000000
 #define	VM_KERN_HEAP_INITIAL_SIZE	0x100000
@@ -69,5 +70,14 @@ void	*alloc(uint32_t size, int page_align, struct vm_heap *heap);
  * Releases a block allocated with '_alloc'.
  */
 void free(void *p, struct vm_heap *heap);
+
+/*
+ * Usable size of the block p, which may be more than what was asked to alloc().
+ */
+size_t	alloc_size(void *p);
+
+/* the kernel's heap is shared by every CPU, it is our most contended lock. */
+extern struct vm_heap	*kernel_heap;
+extern struct mcs_lock	 kernel_heap_lock;
 #endif /* ndef INCLUDE_HEAP_H */
 
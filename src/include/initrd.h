@@ -9,14 +9,8 @@
 #include <common.h>
 #include <vfs.h>
 
-struct initrd_file_header {
-	char *filename[101];
-	size_t siz;
-	char *data;
-};
-
-// Initialises the initial ramdisk. It gets passed the address of the multiboot module,
-// and returns a completed filesystem node.
-struct vfs_node *	init_initrd(void *addr);
+// Initialises the initial ramdisk. It gets passed the address and length of the
+// multiboot module, and returns a completed filesystem node.
+struct vfs_node *	init_initrd(void *addr, size_t len);
 
 #endif /* ndef INITRD_H */
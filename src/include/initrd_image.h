@@ -0,0 +1,73 @@
+#ifndef INITRD_IMAGE_H
+#define INITRD_IMAGE_H
+/*
+ * initrd_image.h -- the prebuilt initrd image format, written by
+ * tools/mkinitrd and mounted as is by the kernel, see init_initrd().
+ *
+ * It is shared with the host tool: it needs uint32_t and uint8_t only, the
+ * includer provides them (<common.h> or <stdint.h>).
+ *
+ * All the fields are little endian, offsets are from the start of the image:
+ *
+ *	struct initrd_image_header
+ *	struct initrd_image_node	[ih_nnodes], node 0 is the root
+ *	uint32_t			[ih_nhash], node numbers or INITRD_NONE
+ *	char				[ih_strsiz], NUL terminated strings
+ *	file data, each page aligned unless compressed
+ *
+ * The nodes are numbered breadth first so the children of a directory are
+ * the contiguous in_nchildren nodes from in_child, sorted by name. The hash
+ * table indexes every node but the root by (parent, name).
+ *
+ * Files may be stored as one LZ4 block (see lz4.h) of in_csize bytes, which
+ * the kernel decompresses on first use.
+ */
+
+#define	INITRD_IMAGE_MAGIC	0x44524e49 /* "INRD" */
+#define	INITRD_IMAGE_VERSION	2
+#define	INITRD_IMAGE_ALIGN	0x1000
+#define	INITRD_NONE		0xffffffff
+
+/* in_type values */
+#define	INITRD_IMAGE_FILE	0
+#define	INITRD_IMAGE_DIR	1
+#define	INITRD_IMAGE_SYMLINK	2 /* in_data is the target, in the strtab */
+
+struct initrd_image_header {
+	uint32_t	ih_magic;
+	uint32_t	ih_version;
+	uint32_t	ih_size;    /* of the whole image */
+	uint32_t	ih_nnodes;
+	uint32_t	ih_nodes;   /* offset of the nodes */
+	uint32_t	ih_nhash;   /* a power of 2, at least twice ih_nnodes */
+	uint32_t	ih_hash;
+	uint32_t	ih_strsiz;
+	uint32_t	ih_strtab;
+};
+
+struct initrd_image_node {
+	uint32_t	in_name;      /* strtab offset */
+	uint32_t	in_parent;
+	uint32_t	in_type;
+	uint32_t	in_size;
+	uint32_t	in_csize;     /* compressed size, 0 if stored as is */
+	uint32_t	in_data;      /* image offset, strtab offset for symlinks */
+	uint32_t	in_child;     /* directories: first child */
+	uint32_t	in_nchildren;
+};
+
+/* the hash of the child name of the directory parent, FNV-1a. */
+static inline uint32_t
+initrd_image_hash(uint32_t parent, const char *name)
+{
+	uint32_t h = 2166136261u;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		h = (h ^ ((parent >> (8 * i)) & 0xff)) * 16777619u;
+	while (*name != '\0')
+		h = (h ^ (uint8_t)*name++) * 16777619u;
+	return (h);
+}
+
+#endif /* ndef INITRD_IMAGE_H */
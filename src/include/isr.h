@@ -6,6 +6,7 @@
  * Rewritten for JamesM's kernel development tutorials.
  */
 #include <common.h>
+#include <vfs.h>
 
 #define IRQ0	32
 #define IRQ1	33
@@ -23,6 +24,11 @@
 #define IRQ13	45
 #define IRQ14	46
 #define IRQ15	47
+#define NIRQ	32 /* IRQ vectors are IRQ0 to IRQ0 + NIRQ - 1 */
+#define	NISAIRQ	16 /* lines of the 8259 PICs */
+#define	NIOIRQ	24 /* I/O APIC inputs, the external IRQs are below that */
+#define	IRQ_LAPIC_TIMER	(IRQ0 + NIOIRQ)
+#define	IRQ_IPI_RESCHED	(IRQ0 + NIOIRQ + 1) /* see sched_preempt() */
 
 struct cpu_regs
 {
@@ -34,9 +40,68 @@ struct cpu_regs
 
 /*
  * Enables registration of callbacks for interrupts or IRQs.  For IRQs, to ease
- * confusion, use the #defines above as the first parameter.
+ * confusion, use the #defines above as the first parameter. Handlers get a
+ * pointer to the state saved on the stack by the interrupt stub, changes made
+ * to it are restored on return.
+ *
+ * Several handlers can be chained on the same vector (shared IRQ lines), they
+ * are all called in registration order and each return INTR_HANDLED if the
+ * interrupt was for it, INTR_STRAY otherwise.
  */
-typedef	void (*isrhdl_t)(struct cpu_regs);
+#define	INTR_STRAY	0
+#define	INTR_HANDLED	1
 
-void register_interrupt_handler(uint32_t n, isrhdl_t handler);
+typedef	int (*isrhdl_t)(struct cpu_regs *regs, void *cookie);
+
+/*
+ * A handler in a vector chain. The storage is provided by the caller and must
+ * stay valid until intr_disestablish().
+ */
+struct intr_handler {
+	const char	*ih_name;
+	isrhdl_t	 ih_func;
+	void		*ih_cookie; /* given to ih_func */
+	uint64_t	 ih_calls;   /* times ih_func has been called */
+	uint64_t	 ih_handled; /* times it returned INTR_HANDLED */
+	uint64_t	 ih_cycles;  /* total time spent in ih_func */
+	uint64_t	 ih_max;     /* longest ih_func run */
+	LIST_ENTRY(intr_handler)	ih_link;
+};
+
+/*
+ * The controller delivering the external IRQs (below NIOIRQ), the 8259 PICs
+ * until an I/O APIC takes over. The interrupts raised by the local APIC itself
+ * are always acknowledged with lapic_eoi().
+ */
+struct intr_pic {
+	const char	*ip_name;
+	void		(*ip_eoi)(uint32_t irq);
+	void		(*ip_mask)(uint32_t irq, int masked);
+};
+
+extern struct intr_pic	*intr_pic;
+
+/* add ih at the end of the vector n chain. */
+void	intr_establish(uint32_t n, struct intr_handler *ih);
+/* remove ih from the vector n chain, can be called from a handler. */
+void	intr_disestablish(uint32_t n, struct intr_handler *ih);
+
+/*
+ * Per IRQ line accounting of the hard interrupt time, in TSC cycles. The
+ * deferred (softirq) part of the work is not accounted.
+ */
+struct irq_stat {
+	uint64_t	is_count;  /* number of interrupts */
+	uint64_t	is_cycles; /* total time spent in the handler */
+	uint64_t	is_max;    /* longest handler run */
+	uint64_t	is_stray;  /* interrupts no handler claimed */
+};
+#define	IRQ_STATS_BUFSIZ	2048
+
+extern struct irq_stat	irq_stats[NIRQ];
+extern struct vfs_node	irq_stats_node; /* the node for /dev/interrupts */
+
+/* format the statistics as text into buf, return the length. */
+size_t	irq_stats_format(char *buf, size_t size);
+void	irq_stats_print(void);
 #endif /* ndef ISR_H */
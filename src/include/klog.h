@@ -0,0 +1,68 @@
+#ifndef KLOG_H
+#define KLOG_H
+/*
+ * klog.h -- kernel message buffer (dmesg).
+ *
+ * Messages are appended as fixed-size records into a ring, each record
+ * carrying a sequence number. Appending never blocks: a writer reserves a
+ * sequence number with an atomic increment, copies its text and commits the
+ * record. Sinks (the screen, a serial line...) are fed separately by
+ * klog_drain().
+ */
+#include <common.h>
+#include <vfs.h>
+
+#define	KLOG_NRECS	512 /* number of records in the ring, a power of 2. */
+#define	KLOG_TEXTSIZ	120 /* bytes of text a single record can hold. */
+
+struct klog_rec {
+	volatile uint32_t	kr_seq; /* sequence number of the committed
+					   record, KLOG_SEQ_BUSY while it is
+					   written. */
+	uint32_t		kr_len; /* length of kr_text. */
+	char			kr_text[KLOG_TEXTSIZ];
+};
+#define	KLOG_SEQ_BUSY	0xFFFFFFFF
+
+/*
+ * An output device fed by klog_drain(). Each sink has its own sequence
+ * cursor, so a sink registered late still gets the whole retained log.
+ */
+struct klog_sink {
+	const char	*ks_name;
+	void		(*ks_putc)(char c);
+	void		(*ks_flush)(void); /* wait until the output is done, may
+					     be NULL. */
+	uint32_t	 ks_seq;  /* next record to output. */
+	SLIST_ENTRY(klog_sink)	ks_link;
+};
+
+
+/* append len bytes of s to the log, without feeding the sinks. */
+void	klog_append(const char *s, size_t len);
+
+/* format and append a message to the log, without feeding the sinks. */
+int	klog_printf(const char *fmt, ...);
+int	klog_vprintf(const char *fmt, va_list ap);
+
+/*
+ * Feed every sink with the records they did not output yet. Only one context
+ * drains at a time, the others return immediately.
+ */
+void	klog_drain(void);
+
+/* drain and flush the sinks no matter who is currently draining. */
+void	klog_panic(void);
+
+void	klog_sink_register(struct klog_sink *ks);
+
+/*
+ * Copy up to len bytes of the retained log, starting offset bytes after the
+ * oldest record, into buf. Return the number of bytes copied.
+ */
+uint32_t	klog_read(uint32_t offset, uint32_t len, char *buf);
+
+/* the node for /dev/kmsg */
+extern struct vfs_node	klog_node;
+
+#endif /* ndef KLOG_H */
@@ -0,0 +1,68 @@
+#ifndef LOCKSTAT_H
+#define LOCKSTAT_H
+/*
+ * lockstat.h -- lock contention statistics.
+ *
+ * Built with -DLOCKSTAT (see the Makefile), every lock counts its
+ * acquisitions, how many of them had to wait and for how many TSC cycles.
+ * Locks register themselves on their first acquisition and are reported
+ * grouped by name, the lock class. The counters are updated while holding
+ * the lock, so they are only approximate for rwlock readers.
+ */
+#include <common.h>
+#include <clock.h>
+#include <vfs.h>
+
+#define	LOCKSTAT_BUFSIZ	2048
+
+struct lock_stat {
+	const char		*ls_name;
+	uint64_t		 ls_acquired;
+	uint64_t		 ls_contended; /* acquisitions which waited */
+	uint64_t		 ls_wait;      /* total cycles spent waiting */
+	uint64_t		 ls_maxwait;
+	struct lock_stat	*ls_next;      /* in the registered list */
+	volatile uint32_t	 ls_listed;
+};
+
+void	lockstat_register(struct lock_stat *ls, const char *name);
+
+
+/*
+ * The lock functions keep a uint64_t set by LOCKSTAT_BEGIN() when they have
+ * to wait, 0 otherwise, and call LOCKSTAT_ACQUIRED() once they own the lock.
+ */
+#ifdef LOCKSTAT
+#define	LOCKSTAT_BEGIN(t)		((t) = clock_cycles())
+#define	LOCKSTAT_ACQUIRED(ls, name, t)	lockstat_acquired((ls), (name), (t))
+
+static inline void
+lockstat_acquired(struct lock_stat *ls, const char *name, uint64_t t)
+{
+	uint64_t wait;
+
+	if (!ls->ls_listed)
+		lockstat_register(ls, name);
+	ls->ls_acquired++;
+	if (t != 0) {
+		wait = clock_cycles() - t;
+		ls->ls_contended++;
+		ls->ls_wait += wait;
+		if (wait > ls->ls_maxwait)
+			ls->ls_maxwait = wait;
+	}
+}
+#else
+#define	LOCKSTAT_BEGIN(t)		((void)(t))
+#define	LOCKSTAT_ACQUIRED(ls, name, t)	((void)(t))
+#endif /* LOCKSTAT */
+
+
+/* format the statistics as text into buf, return the length. */
+size_t	lockstat_format(char *buf, size_t size);
+void	lockstat_print(void);
+
+/* the node for /dev/lockstat */
+extern struct vfs_node	lockstat_node;
+
+#endif /* ndef LOCKSTAT_H */
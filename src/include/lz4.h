@@ -0,0 +1,19 @@
+#ifndef LZ4_H
+#define LZ4_H
+/*
+ * lz4.h -- LZ4 block decoder.
+ *
+ * A block is a sequence of literal runs and matches, without any header: the
+ * sizes are stored aside, see the initrd image. The compressor is in
+ * tools/mkinitrd.c.
+ */
+#include <common.h>
+
+/*
+ * Decompress the srclen bytes block at src into the dstlen bytes at dst.
+ * Return the decompressed length, or -1 if the block is corrupt or does not
+ * fit.
+ */
+int	lz4_decompress(const void *src, size_t srclen, void *dst, size_t dstlen);
+
+#endif /* ndef LZ4_H */
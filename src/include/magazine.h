@@ -0,0 +1,36 @@
+#ifndef MAGAZINE_H
+#define MAGAZINE_H
+/*
+ * magazine.h -- per-CPU object caches in front of the kernel heap.
+ *
+ * Small allocations are rounded up to a size class. Each CPU keeps, for
+ * every class, two magazines (arrays of free objects) it allocates from and
+ * frees to without any lock. Full and empty magazines are exchanged with a
+ * per-class depot, shared by the CPUs, only when both are exhausted. See
+ * Bonwick and Adams, "Magazines and Vmem", USENIX 2001.
+ */
+#include <common.h>
+
+#define	MAG_NCLASS	8    /* size classes, from 16 to 2048 bytes */
+#define	MAG_MAXSIZE	2048 /* larger requests go to the heap */
+#define	MAG_ROUNDS	15   /* objects per magazine */
+#define	MAG_DEPOT_MAX	16   /* full magazines a depot keeps per class */
+
+/*
+ * Return an object of at least len bytes from the calling CPU cache, or NULL
+ * if len is too big or the caches are empty: the caller must then use the
+ * heap.
+ */
+void	*mag_alloc(size_t len);
+
+/*
+ * Give p, allocated from the kernel heap, back to the calling CPU cache.
+ * Return -1 if the caches don't want it: the caller must then free it to the
+ * heap.
+ */
+int	mag_free(void *p);
+
+/* per class statistics */
+void	mag_stats_print(void);
+
+#endif /* ndef MAGAZINE_H */
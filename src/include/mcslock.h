@@ -0,0 +1,90 @@
+#ifndef MCSLOCK_H
+#define MCSLOCK_H
+/*
+ * mcslock.h -- queued spinlocks (Mellor-Crummey and Scott).
+ *
+ * Each waiter spins on its own struct mcs_node, provided by the caller
+ * (usually on its stack) and linked behind the previous waiter: the lock
+ * cache line is only touched once per acquisition, which keeps highly
+ * contended locks from saturating the bus. The node must stay valid until
+ * mcs_unlock().
+ */
+#include <common.h>
+#include <atomic.h>
+#include <lockstat.h>
+
+struct mcs_node {
+	struct mcs_node * volatile	mn_next;
+	volatile uint32_t		mn_locked; /* non-zero while waiting */
+};
+
+struct mcs_lock {
+	struct mcs_node * volatile	 ml_tail; /* last waiter, NULL if free */
+	const char			*ml_name;
+#ifdef LOCKSTAT
+	struct lock_stat		 ml_stat;
+#endif
+};
+#define	MCS_LOCK_INITIALIZER(name)	{ .ml_name = (name) }
+
+
+static inline void
+mcs_lock(struct mcs_lock *ml, struct mcs_node *mn)
+{
+	struct mcs_node *prev;
+	uint64_t t = 0;
+
+	mn->mn_next = NULL;
+	mn->mn_locked = 1;
+	prev = (struct mcs_node *)atomic_swap((volatile uint32_t *)&ml->ml_tail,
+	    (uint32_t)mn);
+	if (prev != NULL) {
+		LOCKSTAT_BEGIN(t);
+		atomic_store_rel((volatile uint32_t *)&prev->mn_next,
+		    (uint32_t)mn);
+		while (atomic_load_acq(&mn->mn_locked))
+			asm volatile ("pause");
+	}
+	LOCKSTAT_ACQUIRED(&ml->ml_stat, ml->ml_name, t);
+}
+
+
+static inline void
+mcs_unlock(struct mcs_lock *ml, struct mcs_node *mn)
+{
+	struct mcs_node *next;
+
+	if ((next = mn->mn_next) == NULL) {
+		/* no known successor: free the lock if we are still the tail. */
+		if (atomic_cmpset((volatile uint32_t *)&ml->ml_tail,
+		    (uint32_t)mn, (uint32_t)NULL))
+			return;
+		/* a successor is linking itself behind us. */
+		while ((next = mn->mn_next) == NULL)
+			asm volatile ("pause");
+	}
+	atomic_store_rel(&next->mn_locked, 0);
+}
+
+
+static inline uint32_t
+mcs_lock_irqsave(struct mcs_lock *ml, struct mcs_node *mn)
+{
+	uint32_t eflags;
+
+	eflags = intr_disable();
+	mcs_lock(ml, mn);
+	return (eflags);
+}
+
+
+static inline void
+mcs_unlock_irqrestore(struct mcs_lock *ml, struct mcs_node *mn,
+    uint32_t eflags)
+{
+
+	mcs_unlock(ml, mn);
+	intr_restore(eflags);
+}
+
+#endif /* ndef MCSLOCK_H */
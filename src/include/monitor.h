@@ -5,10 +5,13 @@
  * From JamesM's kernel development tutorials.
  */
 #include <common.h>
+#include <klog.h>
 
 
 void	mon_putchar(char c); /* Write a single character out to the screen. */
 void	mon_clear(void); /* Clear the screen. */
 void	mon_write(char *s); /* Output a null-terminated ASCII string to the monitor. */
 
+extern struct klog_sink	mon_klog_sink; /* feeds the screen with the kernel log. */
+
 #endif /* ndef MONITOR_H */
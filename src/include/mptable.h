@@ -0,0 +1,57 @@
+#ifndef MPTABLE_H
+#define MPTABLE_H
+/*
+ * mptable.h -- Intel MultiProcessor Specification (1.4) tables parser.
+ *
+ * The MP tables describe the processors (through their local APIC ID), the
+ * I/O APICs and how the ISA interrupts are wired to the I/O APIC inputs.
+ */
+#include <common.h>
+
+#define	MP_MAXCPU	16
+#define	MP_MAXIOAPIC	4
+#define	MP_NISAIRQ	16
+
+/* mp_irq flags, see the MP specification table 4-10 */
+#define	MP_IRQ_POLARITY(f)	((f) & 0x3)
+#define	MP_IRQ_TRIGGER(f)	(((f) >> 2) & 0x3)
+#define	MP_IRQ_ACTIVE_LOW	0x3 /* polarity */
+#define	MP_IRQ_LEVEL		0x3 /* trigger mode */
+
+struct mp_cpu {
+	uint8_t		mc_apic_id;
+	uint8_t		mc_bsp; /* is it the bootstrap processor? */
+};
+
+struct mp_ioapic {
+	uint8_t		mi_id;
+	uint32_t	mi_addr; /* physical address of the registers */
+};
+
+/* where an ISA IRQ is wired */
+struct mp_irq {
+	uint8_t		mr_ioapic; /* index in mp_ioapics */
+	uint8_t		mr_intin;  /* I/O APIC input pin */
+	uint16_t	mr_flags;  /* polarity and trigger mode */
+};
+
+struct mp_config {
+	uint32_t		mp_lapic_addr; /* physical address */
+	int			mp_imcr;       /* PIC mode, IMCR present */
+	uint32_t		mp_ncpu;
+	struct mp_cpu		mp_cpus[MP_MAXCPU];
+	uint32_t		mp_nioapic;
+	struct mp_ioapic	mp_ioapics[MP_MAXIOAPIC];
+	struct mp_irq		mp_isa_irqs[MP_NISAIRQ];
+};
+
+extern struct mp_config	mp_config;
+
+/*
+ * Look for the MP floating pointer structure and parse the configuration
+ * table into mp_config. Return -1 if there is none (or only a default
+ * configuration, which we don't support).
+ */
+int	mp_probe(void);
+
+#endif /* ndef MPTABLE_H */
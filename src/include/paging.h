@@ -60,8 +60,25 @@ void	alloc_frame(struct vm_page *p, int is_kernel, int is_writeable);
 /* routine to unmap page's frame. */
 void free_frame(struct vm_page *p);
 
+/*
+ * Identity map the page of device registers at phys in the kernel directory,
+ * with caching disabled. Return the address to use (phys).
+ */
+void	*map_mmio(uint32_t phys);
+
+/*
+ * Map the frame backing the kernel address kva at va in dir, read-only and
+ * user accessible. The frame stays owned by its kernel mapping. Return -1
+ * if kva is not mapped or if va already is.
+ *
+ * Only this CPU's TLB is flushed: dir must not be in use on another CPU.
+ */
+int	share_page(uint32_t kva, uint32_t va, struct vm_page_directory *dir);
+/* undo share_page(), the frame is left alone. */
+void	unshare_page(uint32_t va, struct vm_page_directory *dir);
+
 /**
  * Page faults handler.
  */
-void page_fault_handler(struct cpu_regs regs);
+int page_fault_handler(struct cpu_regs *regs, void *cookie);
 #endif /* ndef PAGING_H */
@@ -0,0 +1,86 @@
+#ifndef RWLOCK_H
+#define RWLOCK_H
+/*
+ * rwlock.h -- reader-writer spinlocks.
+ *
+ * The state word holds the number of readers, RW_WRITER while a writer owns
+ * the lock and RW_WANTED while a writer waits. New readers back off as soon
+ * as a writer waits, so writers don't starve.
+ */
+#include <common.h>
+#include <atomic.h>
+#include <lockstat.h>
+
+#define	RW_WRITER	0x80000000
+#define	RW_WANTED	0x40000000
+#define	RW_READERS	0x3FFFFFFF
+
+struct rwlock {
+	volatile uint32_t	 rw_state;
+	const char		*rw_name;
+#ifdef LOCKSTAT
+	struct lock_stat	 rw_stat;
+#endif
+};
+#define	RWLOCK_INITIALIZER(name)	{ .rw_name = (name) }
+
+
+static inline void
+rw_rlock(struct rwlock *rw)
+{
+	uint32_t s;
+	uint64_t t = 0;
+
+	for (;;) {
+		s = atomic_load_acq(&rw->rw_state);
+		if ((s & (RW_WRITER | RW_WANTED)) == 0 &&
+		    atomic_cmpset(&rw->rw_state, s, s + 1))
+			break;
+		if (t == 0)
+			LOCKSTAT_BEGIN(t);
+		asm volatile ("pause");
+	}
+	LOCKSTAT_ACQUIRED(&rw->rw_stat, rw->rw_name, t);
+}
+
+
+static inline void
+rw_runlock(struct rwlock *rw)
+{
+
+	(void)atomic_fetchadd(&rw->rw_state, -1);
+}
+
+
+static inline void
+rw_wlock(struct rwlock *rw)
+{
+	uint32_t s;
+	uint64_t t = 0;
+
+	for (;;) {
+		s = atomic_load_acq(&rw->rw_state);
+		if ((s & ~RW_WANTED) == 0) {
+			/* free: take it, clearing our wish. */
+			if (atomic_cmpset(&rw->rw_state, s, RW_WRITER))
+				break;
+		} else if ((s & RW_WANTED) == 0) {
+			(void)atomic_cmpset(&rw->rw_state, s, s | RW_WANTED);
+		}
+		if (t == 0)
+			LOCKSTAT_BEGIN(t);
+		asm volatile ("pause");
+	}
+	LOCKSTAT_ACQUIRED(&rw->rw_stat, rw->rw_name, t);
+}
+
+
+static inline void
+rw_wunlock(struct rwlock *rw)
+{
+
+	/* keep RW_WANTED, another writer may have set it meanwhile. */
+	(void)atomic_fetchadd(&rw->rw_state, -RW_WRITER);
+}
+
+#endif /* ndef RWLOCK_H */
@@ -0,0 +1,28 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+/*
+ * serial.h -- 16550 UART driver, used as a kernel log sink.
+ */
+#include <common.h>
+#include <klog.h>
+
+#define	COM1_PORT	0x3F8
+#define	SERIAL_BAUD	115200
+#define	SERIAL_TXBUFSIZ	4096 /* transmit ring size, a power of 2. */
+
+/*
+ * Probe and initialise COM1, register its IRQ handler and its kernel log
+ * sink. Return -1 if there is no UART.
+ */
+int	init_serial(void);
+
+/* queue c for transmission. Only busy-wait when the ring is full. */
+void	serial_putc(char c);
+
+/* wait until everything queued has been sent. */
+void	serial_flush(void);
+
+extern struct klog_sink	serial_klog_sink;
+extern struct vfs_node	serial_node; /* the node for /dev/ttyS0 */
+
+#endif /* ndef SERIAL_H */
@@ -0,0 +1,37 @@
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+/*
+ * softirq.h -- deferred interrupt work (bottom halves).
+ *
+ * Interrupt handlers only do the urgent part of their job and raise a
+ * softirq for the rest. Pending softirqs are run when leaving the outermost
+ * interrupt, after the EOI and with interrupts enabled.
+ */
+#include <common.h>
+
+#define	SOFTIRQ_TIMER	0 /* run the expired timers */
+#define	SOFTIRQ_KLOG	1 /* feed the kernel log sinks */
+#define	SOFTIRQ_TASKLET	2 /* run the scheduled tasklets */
+#define	NSOFTIRQ	8
+
+typedef void (*softirq_func_t)(void);
+
+void	open_softirq(uint32_t nr, softirq_func_t func);
+
+/* mark the softirq nr pending, can be called from any context. */
+void	raise_softirq(uint32_t nr);
+
+/* bracket hardware interrupt handlers, irq_exit() runs the softirqs. */
+void	irq_enter(void);
+void	irq_exit(void);
+
+/*
+ * Run the pending softirqs outside of any interrupt, for the idle loop
+ * which may otherwise wait long for one. Called with interrupts disabled.
+ */
+void	softirq_poll(void);
+
+int	in_irq(void);       /* are we in a hardware interrupt handler? */
+int	in_interrupt(void); /* in a hardware interrupt or a softirq? */
+
+#endif /* ndef SOFTIRQ_H */
@@ -0,0 +1,93 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+/*
+ * spinlock.h -- busy-waiting mutual exclusion between CPUs.
+ *
+ * Spinlocks are ticket locks: a CPU takes the next ticket and waits until
+ * it is served, so the lock is granted in FIFO order. A lock taken from an
+ * interrupt handler must be taken with interrupts disabled everywhere else,
+ * see spin_lock_irqsave(). Spinlocks do not nest on the same CPU.
+ */
+#include <common.h>
+#include <atomic.h>
+#include <lockstat.h>
+
+struct spinlock {
+	volatile uint32_t	 sl_next;  /* next ticket to give */
+	volatile uint32_t	 sl_owner; /* ticket holding the lock */
+	const char		*sl_name;
+#ifdef LOCKSTAT
+	struct lock_stat	 sl_stat;
+#endif
+};
+#define	SPINLOCK_INITIALIZER(name)	{ .sl_name = (name) }
+
+
+static inline void
+spin_init(struct spinlock *sl, const char *name)
+{
+
+	bzero(sl, sizeof(struct spinlock));
+	sl->sl_name = name;
+}
+
+
+static inline void
+spin_lock(struct spinlock *sl)
+{
+	uint32_t ticket;
+	uint64_t t = 0;
+
+	ticket = atomic_fetchadd(&sl->sl_next, 1);
+	if (atomic_load_acq(&sl->sl_owner) != ticket) {
+		LOCKSTAT_BEGIN(t);
+		while (atomic_load_acq(&sl->sl_owner) != ticket)
+			asm volatile ("pause");
+	}
+	LOCKSTAT_ACQUIRED(&sl->sl_stat, sl->sl_name, t);
+}
+
+
+static inline int
+spin_trylock(struct spinlock *sl)
+{
+	uint32_t owner = atomic_load_acq(&sl->sl_owner);
+	uint64_t t = 0;
+
+	if (!atomic_cmpset(&sl->sl_next, owner, owner + 1))
+		return (0);
+	LOCKSTAT_ACQUIRED(&sl->sl_stat, sl->sl_name, t);
+	return (1);
+}
+
+
+static inline void
+spin_unlock(struct spinlock *sl)
+{
+
+	/* only the owner writes sl_owner. */
+	atomic_store_rel(&sl->sl_owner, sl->sl_owner + 1);
+}
+
+
+/* disable the interrupts and take sl, return the eflags to restore. */
+static inline uint32_t
+spin_lock_irqsave(struct spinlock *sl)
+{
+	uint32_t eflags;
+
+	eflags = intr_disable();
+	spin_lock(sl);
+	return (eflags);
+}
+
+
+static inline void
+spin_unlock_irqrestore(struct spinlock *sl, uint32_t eflags)
+{
+
+	spin_unlock(sl);
+	intr_restore(eflags);
+}
+
+#endif /* ndef SPINLOCK_H */
@@ -3,20 +3,46 @@
 /*
  * tar.h
  *
- * A (very) basic and naive "tape archive" parser implementation.
+ * A (very) basic and naive "tape archive" parser implementation. It knows
+ * about ustar prefixes, GNU long names, pax path/linkpath/size records and
+ * base-256 sizes.
+ *
+ * The archive is indexed into one flat array of tar_entry. Entries do not
+ * copy anything: paths, link targets and data are offsets in the archive,
+ * whose headers are rewritten in place to hold NUL terminated paths.
  */
 #include <common.h>
 
+/* te_type values */
+#define	TAR_FILE	0
+#define	TAR_DIR		1
+#define	TAR_SYMLINK	2
+#define	TAR_HARDLINK	3 /* te_link names the file whose data to share */
+
+struct tar_entry {
+	uint32_t	te_path;  /* relative, without "./" nor trailing '/' */
+	uint32_t	te_link;  /* link target, 0 unless a link */
+	uint32_t	te_data;
+	uint32_t	te_size;
+	uint32_t	te_type;
+};
 
-struct tar_file {
-	char	 tf_filename[101];
-	size_t	 tf_datasiz;
-	char	*tf_data;
-	TAILQ_ENTRY(tar_file)	entries;
+struct tar_index {
+	char			*ti_base;    /* the archive */
+	uint32_t		 ti_count;
+	struct tar_entry	*ti_entries; /* ti_count of them, in archive order */
 };
-TAILQ_HEAD(tar_fileQ, tar_file);
 
+#define	TAR_PATH(ti, te)	((ti)->ti_base + (te)->te_path)
+#define	TAR_LINK(ti, te)	((ti)->ti_base + (te)->te_link)
+#define	TAR_DATA(ti, te)	((ti)->ti_base + (te)->te_data)
 
-int	tar_parse_mem(void *addr, struct tar_fileQ **q_p);
+
+/*
+ * Index the len bytes archive at addr into *ti_p, in one allocation sized
+ * by a first pass over the headers. Entries of other types (devices,
+ * fifos...) are skipped. Return the number of entries, or -1 on error.
+ */
+int	tar_parse_mem(void *addr, size_t len, struct tar_index **ti_p);
 
 #endif /* ndef TAR_H */
@@ -0,0 +1,85 @@
+#ifndef TASK_H
+#define TASK_H
+/*
+ * task.h -- kernel tasks and the scheduler.
+ *
+ * Each task has its own kernel stack, the context switch only saves the
+ * callee saved registers on it (see asm/switch.s). Runnable tasks wait in a
+ * single run queue shared by the CPUs, a CPU with nothing to run switches to
+ * its idle task. Tasks are preempted when their time slice is over, but only
+ * on the way out of a hardware interrupt: code running with interrupts
+ * disabled, as every spinlock holder does, is never preempted.
+ */
+#include <common.h>
+#include <timer.h>
+
+#define	TASK_STACKSIZ	0x2000 /* kernel stack of a task */
+#define	TASK_NAMELEN	16
+#define	TASK_SLICE	10     /* time slice, in ms */
+#define	TASK_NFILES	16     /* file descriptors of a task */
+
+/* t_state values */
+#define	TASK_RUNNING	0 /* running or in the run queue */
+#define	TASK_SLEEPING	1 /* waiting for task_wakeup() */
+#define	TASK_DEAD	2 /* waiting for its stack to be freed */
+
+struct vm_page_directory;
+struct file;
+
+typedef void (*task_func_t)(void *arg);
+
+struct task {
+	uint32_t		 t_esp;   /* saved by switch_context() */
+	uint32_t		 t_id;
+	char			 t_name[TASK_NAMELEN];
+	volatile int		 t_state;
+	void			*t_stack; /* NULL for the idle tasks */
+	struct vm_page_directory	*t_directory; /* loaded when switching
+							 to the task */
+	task_func_t		 t_func;
+	void			*t_arg;
+	struct timer		 t_timer; /* task_sleep() */
+	uint64_t		 t_switches; /* times the task was switched to */
+	TAILQ_ENTRY(task)	 t_runq;
+	struct file		*t_files[TASK_NFILES]; /* see file.h */
+};
+
+
+/*
+ * Turn the boot context into the idle task of the bootstrap CPU and start
+ * the time slice timer. Needs the heap and the timer.
+ */
+void	init_task(void);
+
+/* turn the calling context into the idle task of the current CPU. */
+void	task_init_cpu(void);
+
+/* the task running on the current CPU, NULL before task_init_cpu(). */
+struct task	*curtask(void);
+
+/* create a task running func(arg) in the kernel address space. */
+struct task	*task_create(const char *name, task_func_t func, void *arg);
+
+/* terminate the current task, closing its files. */
+void	task_exit(void) __dead2;
+
+/* give the CPU to the next runnable task, if any. */
+void	task_yield(void);
+
+/* sleep for the given number of ticks. */
+void	task_sleep(uint32_t ticks);
+
+/* make a sleeping task runnable again, can be called from any context. */
+void	task_wakeup(struct task *t);
+
+/* run the idle loop of the current CPU, never returns. */
+void	task_idle(void) __dead2;
+
+/*
+ * Switch task if the current one has been asked to. Called with interrupts
+ * disabled when leaving a hardware interrupt, does nothing when still in
+ * interrupt context.
+ */
+void	sched_preempt(void);
+
+#endif /* ndef TASK_H */
@@ -0,0 +1,33 @@
+#ifndef TASKLET_H
+#define TASKLET_H
+/*
+ * tasklet.h -- small deferred work items for interrupt handlers.
+ *
+ * An interrupt handler schedules a tasklet instead of doing slow work with
+ * interrupts masked. Scheduled tasklets run from the SOFTIRQ_TASKLET softirq,
+ * after the EOI and with interrupts enabled. Scheduling is lock-free and can
+ * be done from any context.
+ */
+#include <common.h>
+
+typedef void (*tasklet_func_t)(void *arg);
+
+struct tasklet {
+	struct tasklet		*tl_next;
+	volatile uint32_t	 tl_queued; /* non-zero while in the queue */
+	tasklet_func_t		 tl_func;
+	void			*tl_arg;
+};
+#define	TASKLET_INITIALIZER(func, arg)	{ NULL, 0, (func), (arg) }
+
+void	init_tasklet(void);
+
+void	tasklet_set(struct tasklet *tl, tasklet_func_t func, void *arg);
+
+/*
+ * Queue tl to run once. Return 0 if it was already queued (it will then only
+ * run once), 1 otherwise. A tasklet can re-schedule itself.
+ */
+int	tasklet_schedule(struct tasklet *tl);
+
+#endif /* ndef TASKLET_H */
@@ -6,6 +6,63 @@
  */
 #include <common.h>
 
-void	init_timer(uint32_t freq);
+#define	PIT_FREQ	1193180 /* input clock of the PIT, in Hz */
+#define	TIMER_HZ	1000    /* default tick rate */
+
+/* PIT I/O ports and command bytes */
+#define	PIT_CH0		0x40
+#define	PIT_CH2		0x42
+#define	PIT_CMD		0x43
+#define	PIT_CH0_RATE	0x36 /* channel 0, lo/hi byte, mode 3 */
+#define	PIT_CH0_ONESHOT	0x30 /* channel 0, lo/hi byte, mode 0 */
+#define	PIT_CH2_ONESHOT	0xB0 /* channel 2, lo/hi byte, mode 0 */
+#define	PIT_CH2_RATE	0xB4 /* channel 2, lo/hi byte, mode 2 */
+#define	PIT_CH2_LATCH	0x80 /* channel 2, counter latch */
+#define	PIT_GATE	0x61 /* channel 2 gate is bit 0, speaker is bit 1 */
+#define	PIT_CH2_OUT	0x20 /* channel 2 output, read from PIT_GATE */
+
+/* init_timer() flags */
+#define	TIMER_PERIODIC	0x0 /* interrupt on every tick */
+#define	TIMER_ONESHOT	0x1 /* only interrupt when the next timer is due */
+#define	TIMER_LAPIC	0x2 /* use the local APIC timer instead of the PIT,
+			       see init_apic() */
+
+typedef void (*timer_func_t)(void *arg);
+
+struct timer {
+	LIST_ENTRY(timer)	 tm_link;
+	uint64_t		 tm_expires; /* tick at which tm_func is called */
+	uint32_t		 tm_period;  /* re-arm delay in ticks, 0 for a
+					        one-shot timer */
+	int			 tm_pending; /* set while in the wheel */
+	timer_func_t		 tm_func;
+	void			*tm_arg;
+};
+
+
+/*
+ * Program the PIT to tick freq times per second. In TIMER_ONESHOT mode the PIT
+ * only fires for the next deadline while the tick count is kept up to date
+ * with a free running counter. With TIMER_LAPIC the local APIC timer replaces
+ * the PIT and the TSC is the free running counter.
+ */
+void	init_timer(uint32_t freq, int flags);
+
+/* ticks elapsed since init_timer(), this never wraps. */
+uint64_t	timer_ticks(void);
+uint32_t	timer_hz(void);
+
+/* initialise t, must be done before any other operation on it. */
+void	timer_set(struct timer *t, timer_func_t func, void *arg);
+
+/*
+ * Arm t so that its function is called in delay ticks, and then every period
+ * ticks for timer_add_periodic(). Re-arming a pending timer moves it.
+ */
+void	timer_add(struct timer *t, uint32_t delay);
+void	timer_add_periodic(struct timer *t, uint32_t period);
+
+/* disarm t, does nothing when it is not pending. */
+void	timer_cancel(struct timer *t);
 
 #endif /* ndef TIMER_H */
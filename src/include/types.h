@@ -1,6 +1,8 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+typedef unsigned long long	uint64_t;
+typedef long long	int64_t;
 typedef unsigned int	uint32_t;
 typedef int		int32_t;
 typedef unsigned short	uint16_t;
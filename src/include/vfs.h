@@ -17,17 +17,29 @@
 #define VFS_MOUNTPOINT  0x08 /* Is the file an active mountpoint? */
 /* Notice that VFS_MOUNTPOINT is given the value 8, not 7. This is so that it can
    be bitwise-OR'd in with VFS_DIRECTORY */
+#define	VFS_NONEGCACHE	0x10 /* directories whose finddir may fail for want of
+				memory: a miss is not cached by vfs_lookup() */
 #define	VFS_ISDIR(node)	(((node)->flags & 0x7) == VFS_DIRECTORY)
 
+#define	VFS_PATHMAX		256 /* of a symlink target */
+#define	VFS_MAXSYMLINKS		8   /* followed by a lookup */
+#define	VFS_MAXDEPTH		32  /* directories deep */
+#define	VFS_NCACHE		256 /* names cached by vfs_lookup() */
+#define	VFS_NCACHEHASH		64
+#define	VFS_CACHE_NAMELEN	32  /* longer names are not cached */
+
 
 struct vfs_node;
+struct dirent;
+struct vm_page_directory;
 
 typedef uint32_t (*vfs_read_func)(struct vfs_node *node, uint32_t offset, uint32_t size, char *buf);
 typedef uint32_t (*vfs_write_func)(struct vfs_node *node, uint32_t offset, uint32_t size, char *buf);
 typedef uint32_t (*vfs_open_func)(struct vfs_node *node, int mode);
 typedef void (*vfs_close_func)(struct vfs_node *node);
-typedef struct dirent * (*vfs_readdir_func)(struct vfs_node *node, uint32_t index);
+typedef int (*vfs_readdir_func)(struct vfs_node *node, uint32_t *cookie, struct dirent *buf, uint32_t n);
 typedef struct vfs_node * (*vfs_finddir_func)(struct vfs_node *node, char *name);
+typedef int (*vfs_map_func)(struct vfs_node *node, uint32_t offset, const void **addrp, uint32_t *lenp);
 
 
 struct vfs_node {
@@ -45,9 +57,21 @@ struct vfs_node {
 	vfs_close_func close;
 	vfs_readdir_func readdir;
 	vfs_finddir_func finddir;
+	vfs_map_func map;     /* Direct access to the file bytes, may be NULL. */
 	struct vfs_node *ptr; /* Used by mountpoints and symlinks. */
 };
 
+/*
+ * A name index for the children of a directory: an open addressing hash
+ * table of nodes, grown as needed. A filesystem keeps one per directory and
+ * can use vfs_dirhash_finddir() as finddir, with impl pointing to it.
+ */
+struct vfs_dirhash {
+	struct vfs_node	**dh_slots;
+	uint32_t	  dh_size;  /* number of slots, 0 or a power of 2 */
+	uint32_t	  dh_count; /* number of nodes */
+};
+
 struct dirent /* One of these is returned by the readdir call, according to POSIX. */
 {
 	char name[128]; /* Filename. */
@@ -62,7 +86,57 @@ uint32_t vfs_read(struct vfs_node *node, uint32_t offset, uint32_t size, char *b
 uint32_t vfs_write(struct vfs_node *node, uint32_t offset, uint32_t size, char *buf);
 uint32_t vfs_open(struct vfs_node *node, int mode);
 void vfs_close(struct vfs_node *node);
-struct dirent * vfs_readdir(struct vfs_node *node, uint32_t index);
+/*
+ * Fill buf with up to n entries of the directory node, from *cookie on, and
+ * advance *cookie past them. Start with a cookie of 0. Return the number of
+ * entries, 0 at the end of the directory.
+ */
+int	vfs_readdir(struct vfs_node *node, uint32_t *cookie,
+	    struct dirent *buf, uint32_t n);
+/* fill the entry d, for filesystems. */
+void	vfs_dirent(struct dirent *d, const char *name, uint32_t inode);
 struct vfs_node * vfs_finddir(struct vfs_node *node, char *name);
+/*
+ * Zero-copy access to a file: set *addrp to its bytes from offset on and
+ * *lenp to their count. They are read-only and stay valid as long as the
+ * filesystem is mounted. Return -1 if the node does not support it.
+ */
+int	vfs_map(struct vfs_node *node, uint32_t offset, const void **addrp,
+	    uint32_t *lenp);
+/*
+ * Map the pages holding len bytes of node from offset on at the page
+ * aligned address va in dir, read-only and user accessible. Return where the
+ * byte at offset lands, or NULL on error with nothing mapped.
+ *
+ * Whole pages are mapped: the first and the last one also show the bytes
+ * around the file in its filesystem, such as other files or archive headers.
+ * The range must not be mapped already and dir not in use on another CPU,
+ * see share_page().
+ */
+void	*vfs_map_pages(struct vfs_node *node, uint32_t offset, uint32_t len,
+	    uint32_t va, struct vm_page_directory *dir);
+
+/* mount the filesystem root on the directory mp, return -1 on error. */
+int vfs_mount(struct vfs_node *mp, struct vfs_node *root);
+
+/*
+ * Resolve path from vfs_root, following mountpoints and symlinks. Return
+ * NULL if there is no such file. The names are cached, see
+ * vfs_cache_purge().
+ */
+struct vfs_node	*vfs_lookup(const char *path);
+/*
+ * Forget what the name cache knows about the directory dir. Filesystems
+ * must call it when adding or removing names in a directory.
+ */
+void	vfs_cache_purge(struct vfs_node *dir);
+
+/* initialise dh with room for n nodes, return -1 when out of memory. */
+int	vfs_dirhash_init(struct vfs_dirhash *dh, uint32_t n);
+/* index node by its name, return -1 when out of memory. */
+int	vfs_dirhash_insert(struct vfs_dirhash *dh, struct vfs_node *node);
+struct vfs_node	*vfs_dirhash_lookup(struct vfs_dirhash *dh, const char *name);
+/* finddir callback for directories whose impl is a struct vfs_dirhash. */
+struct vfs_node	*vfs_dirhash_finddir(struct vfs_node *dir, char *name);
 
 #endif /* ndef VFS_H */
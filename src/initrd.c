@@ -2,127 +2,562 @@
  * initrd.c -- Defines the interface for and structures relating to the initial
  * ramdisk.
  *
+ * The archive paths are split into a directory tree. Every directory keeps
+ * its children in a vfs_dirhash for finddir and in an array, in archive
+ * order, for readdir. Directories missing from the archive are made up.
+ *
+ * Nodes are carved from one array with a slot per archive entry, only the
+ * made-up directories it can't hold are allocated on their own.
+ *
+ * A prebuilt image (see tools/mkinitrd) is used as is instead: its index
+ * answers finddir and readdir, and the vfs_nodes are only made when looked
+ * up, then kept in a small hash by node number. Compressed files are only
+ * decompressed when first read or mapped.
+ *
  * Written for JamesM's kernel development tutorials.
  */
 #include <tar.h>
 #include <initrd.h>
+#include <initrd_image.h>
+#include <lz4.h>
+#include <atomic.h>
+#include <spinlock.h>
+
+
+#define	INITRD_MAXLINKS	8 /* symlinks followed when resolving one */
+
+struct initrd_node {
+	struct vfs_node		 in_vnode;  /* first, see INITRD_NODE() */
+	struct initrd_node	*in_parent;
+	struct tar_entry	*in_entry;  /* NULL if made up */
+	/* directories only */
+	struct vfs_dirhash	 in_names;
+	struct vfs_node		**in_children;
+	uint32_t		 in_nchildren;
+	uint32_t		 in_maxchildren;
+};
+#define	INITRD_NODE(vn)	((struct initrd_node *)(vn))
+
+#define	INITRD_NCACHE	64 /* buckets of the image vfs_node cache */
 
+struct initrd_inode {
+	struct vfs_node		 ii_vnode; /* first, vfs_node to initrd_inode */
+	struct initrd_inode	*ii_next;  /* in its bucket */
+	volatile uint32_t	 ii_data;  /* decompressed data, or 0 */
+};
 
-static struct tar_fileQ	*tar_files;
-static struct vfs_node	*initrd_root;  /* Our root directory node. */
-static struct vfs_node	*initrd_dev;   /* We also add a directory node for /dev, so we can mount devfs later on. */
-static struct vfs_node	*root_nodes;   /* List of file nodes. */
-static size_t		 nroot_nodes;  /* Number of file nodes. */
-static struct dirent	 dirent;
 
+static struct tar_index	*initrd_index;
+static struct initrd_node	*initrd_root; /* Our root directory node. */
+static struct initrd_node	*initrd_pool;
+static uint32_t		 initrd_npool;
+static uint32_t		 initrd_ninodes;
 
+static char			*initrd_image;  /* NULL unless an image */
+static struct initrd_image_node	*initrd_inodes;
+static uint32_t			*initrd_ihash;
+static struct initrd_inode	*initrd_icache[INITRD_NCACHE];
+static struct spinlock		 initrd_ilock =
+				    SPINLOCK_INITIALIZER("initrd_icache");
+
+
+/*
+ * file nodes are bound to their tar_entry through impl, see init_initrd().
+ * Symlinks read as their target.
+ */
 static uint32_t
 initrd_read(struct vfs_node *node, uint32_t offset, uint32_t size, char *buffer)
 {
+	struct tar_entry *te = (struct tar_entry *)node->impl;
+	const char *data;
+	uint32_t len;
+
+	if (te == NULL)
+		return (0);
+	if (te->te_type == TAR_SYMLINK) {
+		data = TAR_LINK(initrd_index, te);
+		len  = strlen(data);
+	} else {
+		data = TAR_DATA(initrd_index, te);
+		len  = te->te_size;
+	}
+	if (offset >= len)
+		return (0);
+	if (size > len - offset)
+		size = len - offset;
+	(void)memcpy(buffer, data + offset, size);
+	return (size);
+}
+
+static int
+initrd_map(struct vfs_node *node, uint32_t offset, const void **addrp,
+    uint32_t *lenp)
+{
+	struct tar_entry *te = (struct tar_entry *)node->impl;
+
+	if (te == NULL || te->te_type == TAR_SYMLINK || offset > te->te_size)
+		return (-1);
+	*addrp = TAR_DATA(initrd_index, te) + offset;
+	*lenp  = te->te_size - offset;
+	return (0);
+}
+
+/* the cookie is the index of the next child, here and in image directories. */
+static int
+initrd_readdir(struct vfs_node *node, uint32_t *cookie, struct dirent *buf,
+    uint32_t n)
+{
+	struct initrd_node *dir = INITRD_NODE(node);
+	struct vfs_node *child;
+	uint32_t i;
+
+	for (i = 0; i < n && *cookie < dir->in_nchildren; i++) {
+		child = dir->in_children[(*cookie)++];
+		vfs_dirent(&buf[i], child->name, child->inode);
+	}
+	return (i);
+}
+
+static struct initrd_node *
+initrd_node_alloc(struct initrd_node *parent, const char *name, size_t len,
+    uint32_t flags)
+{
+	struct initrd_node *in;
+	struct vfs_node *vn;
+
+	if (len >= sizeof(vn->name))
+		return (NULL);
+	if (initrd_npool > 0) {
+		in = initrd_pool++;
+		initrd_npool--;
+	} else if ((in = kmalloc0(sizeof(*in))) == NULL)
+		return (NULL);
+	vn = &in->in_vnode;
+	(void)memcpy(vn->name, name, len);
+	vn->name[len] = '\0';
+	vn->flags = flags;
+	vn->inode = initrd_ninodes++;
+	if (flags == VFS_DIRECTORY) {
+		vn->readdir = &initrd_readdir;
+		vn->finddir = &vfs_dirhash_finddir;
+		vn->impl    = (uint32_t)&in->in_names;
+	} else {
+		vn->read = &initrd_read;
+		vn->map  = &initrd_map;
+	}
+	in->in_parent = (parent != NULL ? parent : in);
+	if (parent == NULL)
+		return (in);
+
+	/* link it in its parent. */
+	if (parent->in_nchildren == parent->in_maxchildren) {
+		struct vfs_node **children;
+		uint32_t max = (parent->in_maxchildren > 0 ?
+		    2 * parent->in_maxchildren : 8);
+
+		if ((children = kmalloc(max * sizeof(*children))) == NULL)
+			return (NULL);
+		if (parent->in_nchildren > 0)
+			(void)memcpy(children, parent->in_children,
+			    parent->in_nchildren * sizeof(*children));
+		kfree(parent->in_children);
+		parent->in_children = children;
+		parent->in_maxchildren = max;
+	}
+	if (vfs_dirhash_insert(&parent->in_names, vn) == -1)
+		return (NULL);
+	parent->in_children[parent->in_nchildren++] = vn;
+	return (in);
+}
+
+/*
+ * Find the child of dir named by the len bytes at name. "." and ".." are
+ * understood.
+ */
+static struct initrd_node *
+initrd_child(struct initrd_node *dir, const char *name, size_t len)
+{
+	char buf[sizeof(dir->in_vnode.name)];
+
+	if (len == 1 && name[0] == '.')
+		return (dir);
+	if (len == 2 && name[0] == '.' && name[1] == '.')
+		return (dir->in_parent);
+	if (len >= sizeof(buf))
+		return (NULL);
+	(void)memcpy(buf, name, len);
+	buf[len] = '\0';
+	return (INITRD_NODE(vfs_dirhash_lookup(&dir->in_names, buf)));
+}
+
+/*
+ * Resolve path from dir, one component at a time. Symlinks met on the way
+ * are followed, the last component is followed only if follow is set.
+ */
+static struct initrd_node *
+initrd_resolve(struct initrd_node *dir, const char *path, int follow,
+    int depth)
+{
+	struct initrd_node *in = dir;
+	struct tar_entry *te;
+	const char *end;
+
+	if (depth > INITRD_MAXLINKS)
+		return (NULL);
+	if (*path == '/')
+		in = initrd_root;
+	for (;;) {
+		while (*path == '/')
+			path++;
+		if (*path == '\0')
+			return (in);
+		if (!VFS_ISDIR(&in->in_vnode))
+			return (NULL);
+		for (end = path; *end != '\0' && *end != '/'; end++)
+			continue;
+		dir = in;
+		if ((in = initrd_child(dir, path, end - path)) == NULL)
+			return (NULL);
+		te = in->in_entry;
+		if (te != NULL && te->te_type == TAR_SYMLINK &&
+		    (follow || *end != '\0')) {
+			in = initrd_resolve(dir, TAR_LINK(initrd_index, te), 1,
+			    depth + 1);
+			if (in == NULL)
+				return (NULL);
+		}
+		path = end;
+	}
+}
+
+/*
+ * Add the entry te to the tree, making up the missing directories of its
+ * path. An entry replaces a previous one with the same path, as when
+ * extracting.
+ */
+static int
+initrd_add(struct tar_entry *te)
+{
+	struct initrd_node *dir = initrd_root, *in;
+	struct vfs_node *vn;
+	const char *path = TAR_PATH(initrd_index, te), *end;
+	uint32_t flags;
+
+	for (;;) {
+		for (end = path; *end != '\0' && *end != '/'; end++)
+			continue;
+		flags = (*end != '\0' || te->te_type == TAR_DIR ?
+		    VFS_DIRECTORY : te->te_type == TAR_SYMLINK ?
+		    VFS_SYMLINK : VFS_FILE);
+		if ((in = initrd_child(dir, path, end - path)) == NULL &&
+		    (in = initrd_node_alloc(dir, path, end - path, flags)) == NULL)
+			return (-1);
+		if ((in->in_vnode.flags & 0x7) != flags)
+			return (-1); /* file in the way of a directory, or so */
+		if (*end == '\0')
+			break;
+		dir  = in;
+		path = end + 1;
+	}
+
+	vn = &in->in_vnode;
+	in->in_entry = te;
+	if (flags != VFS_DIRECTORY) {
+		vn->impl   = (uint32_t)te;
+		vn->length = (flags == VFS_SYMLINK ?
+		    strlen(TAR_LINK(initrd_index, te)) : te->te_size);
+	}
+	return (0);
+}
+
+static struct vfs_node	*initrd_image_vnode(uint32_t id);
+
+#define	IMAGE_STR(off)	(initrd_image + ih->ih_strtab + (off))
+
+/*
+ * The data of the file or symlink node, decompressed into page aligned heap
+ * memory first if needed. NULL if that fails.
+ */
+static const char *
+initrd_image_data(struct vfs_node *node)
+{
+	struct initrd_image_header *ih = (void *)initrd_image;
+	struct initrd_image_node *in = (void *)node->impl;
+	struct initrd_inode *ii = (struct initrd_inode *)node;
+	char *buf;
+
+	if (in->in_type == INITRD_IMAGE_SYMLINK)
+		return (IMAGE_STR(in->in_data));
+	if (in->in_csize == 0)
+		return (initrd_image + in->in_data);
+	if (ii->ii_data != 0)
+		return ((char *)ii->ii_data);
+
+	/* racing readers both decompress, the loser frees its copy. */
+	if ((buf = kmalloc_a(in->in_size)) == NULL)
+		return (NULL);
+	if (lz4_decompress(initrd_image + in->in_data, in->in_csize, buf,
+	    in->in_size) != (int)in->in_size) {
+		printf("initrd: %s is corrupt\n", node->name);
+		kfree(buf);
+		return (NULL);
+	}
+	if (!atomic_cmpset(&ii->ii_data, 0, (uint32_t)buf))
+		kfree(buf);
+	return ((char *)ii->ii_data);
+}
+
+static uint32_t
+initrd_image_read(struct vfs_node *node, uint32_t offset, uint32_t size,
+    char *buffer)
+{
+	struct initrd_image_node *in = (void *)node->impl;
+	const char *data;
 
-	/* XXX: no check at *all* */
-	struct tar_file *tf = TAILQ_FIRST(tar_files);
-	do {
-		if (strcmp(tf->tf_filename, node->name) == 0)
+	if (offset >= in->in_size || (data = initrd_image_data(node)) == NULL)
+		return (0);
+	if (size > in->in_size - offset)
+		size = in->in_size - offset;
+	(void)memcpy(buffer, data + offset, size);
+	return (size);
+}
+
+/* files are page aligned, in the module which is too, or decompressed. */
+static int
+initrd_image_map(struct vfs_node *node, uint32_t offset, const void **addrp,
+    uint32_t *lenp)
+{
+	struct initrd_image_node *in = (void *)node->impl;
+	const char *data;
+
+	if (in->in_type != INITRD_IMAGE_FILE || offset > in->in_size ||
+	    (data = initrd_image_data(node)) == NULL)
+		return (-1);
+	*addrp = data + offset;
+	*lenp  = in->in_size - offset;
+	return (0);
+}
+
+static int
+initrd_image_readdir(struct vfs_node *node, uint32_t *cookie,
+    struct dirent *buf, uint32_t n)
+{
+	struct initrd_image_header *ih = (void *)initrd_image;
+	struct initrd_image_node *in = (void *)node->impl;
+	uint32_t i, id, off;
+
+	for (i = 0; i < n && *cookie < in->in_nchildren; i++) {
+		id = in->in_child + *cookie;
+		if ((off = initrd_inodes[id].in_name) >= ih->ih_strsiz)
 			break;
-	} while (tf = TAILQ_NEXT(tf, entries));
-	if (tf == NULL || offset > tf->tf_datasiz)
-		return 0;
-	if (offset + size > tf->tf_datasiz)
-		size = tf->tf_datasiz - offset;
-	(void)memcpy(buffer, tf->tf_data + offset, size);
-	return size;
+		vfs_dirent(&buf[i], IMAGE_STR(off), id);
+		(*cookie)++;
+	}
+	return (i);
+}
+
+static struct vfs_node *
+initrd_image_finddir(struct vfs_node *dir, char *name)
+{
+	struct initrd_image_header *ih = (void *)initrd_image;
+	struct initrd_image_node *in;
+	uint32_t i, n, id, mask = ih->ih_nhash - 1;
+
+	i = initrd_image_hash(dir->inode, name) & mask;
+	for (n = 0; n < ih->ih_nhash; n++) {
+		if ((id = initrd_ihash[i]) >= ih->ih_nnodes)
+			break; /* INITRD_NONE */
+		in = &initrd_inodes[id];
+		if (in->in_parent == dir->inode && in->in_name < ih->ih_strsiz &&
+		    strcmp(IMAGE_STR(in->in_name), name) == 0)
+			return (initrd_image_vnode(id));
+		i = (i + 1) & mask;
+	}
+	return (NULL);
 }
 
-static struct dirent *
-initrd_readdir(struct vfs_node *node, uint32_t index)
+/* the cached vfs_node of the image node id, or NULL. Call with the lock. */
+static struct vfs_node *
+initrd_icache_lookup(uint32_t id)
 {
-   if (node == initrd_root && index == 0)
-   {
-     memcpy(dirent.name, "dev", 4);
-     dirent.name[3] = 0; // Make sure the string is NULL-terminated.
-     dirent.inode = 0;
-     return &dirent;
-   }
+	struct initrd_inode *ii;
 
-   if (index-1 >= nroot_nodes)
-       return 0;
-   printf("found %s for index=%d\n", root_nodes[index-1].name, index);
-   memcpy(dirent.name, root_nodes[index-1].name, strlen(root_nodes[index-1].name) + 1);
-   dirent.name[strlen(root_nodes[index-1].name)] = 0; // Make sure the string is NULL-terminated.
-   dirent.inode = root_nodes[index-1].inode;
-   return &dirent;
+	for (ii = initrd_icache[id % INITRD_NCACHE]; ii != NULL;
+	    ii = ii->ii_next) {
+		if (ii->ii_vnode.inode == id)
+			return (&ii->ii_vnode);
+	}
+	return (NULL);
 }
 
-static struct vfs_node *initrd_finddir(struct vfs_node *node, char *name)
+/*
+ * The vfs_node of the image node id, made on first use. They are never
+ * freed, the vfs hands them out without reference counts.
+ */
+static struct vfs_node *
+initrd_image_vnode(uint32_t id)
 {
-   if (node == initrd_root &&
-       !strcmp(name, "dev") )
-       return initrd_dev;
+	struct initrd_image_header *ih = (void *)initrd_image;
+	struct initrd_image_node *in = &initrd_inodes[id];
+	struct initrd_inode *ii, **bucket;
+	struct vfs_node *vn;
+	const char *name;
+	uint32_t eflags;
+	size_t len;
+
+	eflags = spin_lock_irqsave(&initrd_ilock);
+	vn = initrd_icache_lookup(id);
+	spin_unlock_irqrestore(&initrd_ilock, eflags);
+	if (vn != NULL)
+		return (vn);
+
+	/* the header has been checked at mount time, the nodes are now. */
+	if (in->in_name >= ih->ih_strsiz ||
+	    (in->in_type == INITRD_IMAGE_DIR && in->in_nchildren > 0 &&
+	    (in->in_child > ih->ih_nnodes ||
+	    in->in_nchildren > ih->ih_nnodes - in->in_child)) ||
+	    (in->in_type == INITRD_IMAGE_SYMLINK &&
+	    (in->in_data >= ih->ih_strsiz ||
+	    in->in_size != strlen(IMAGE_STR(in->in_data)))) ||
+	    (in->in_type == INITRD_IMAGE_FILE &&
+	    (in->in_data > ih->ih_size || (in->in_csize != 0 ? in->in_csize :
+	    in->in_size) > ih->ih_size - in->in_data))) {
+		printf("initrd: bad image node %u\n", id);
+		return (NULL);
+	}
+
+	if ((ii = kmalloc0(sizeof(*ii))) == NULL)
+		return (NULL);
+	vn = &ii->ii_vnode;
+	name = (id == 0 ? "initrd" : IMAGE_STR(in->in_name));
+	len  = strlen(name);
+	if (len >= sizeof(vn->name))
+		len = sizeof(vn->name) - 1;
+	(void)memcpy(vn->name, name, len);
+	vn->inode  = id;
+	vn->length = in->in_size;
+	vn->impl   = (uint32_t)in;
+	switch (in->in_type) {
+	case INITRD_IMAGE_DIR:
+		vn->flags   = VFS_DIRECTORY | VFS_NONEGCACHE; /* finddir allocates */
+		vn->readdir = &initrd_image_readdir;
+		vn->finddir = &initrd_image_finddir;
+		break;
+	case INITRD_IMAGE_SYMLINK:
+		vn->flags = VFS_SYMLINK;
+		vn->read  = &initrd_image_read;
+		break;
+	default:
+		vn->flags = VFS_FILE;
+		vn->read  = &initrd_image_read;
+		vn->map   = &initrd_image_map;
+		break;
+	}
 
-   int i;
-   for (i = 0; i < nroot_nodes; i++)
-       if (!strcmp(name, root_nodes[i].name))
-           return &root_nodes[i];
-   return 0;
+	/* made without the lock, keep the first one if we raced. */
+	bucket = &initrd_icache[id % INITRD_NCACHE];
+	eflags = spin_lock_irqsave(&initrd_ilock);
+	if ((vn = initrd_icache_lookup(id)) == NULL) {
+		ii->ii_next = *bucket;
+		*bucket = ii;
+		vn = &ii->ii_vnode;
+		ii = NULL;
+	}
+	spin_unlock_irqrestore(&initrd_ilock, eflags);
+	kfree(ii);
+	return (vn);
+}
+
+/*
+ * Mount the prebuilt image at addr: check its header and use its index as
+ * is, whatever the number of files.
+ */
+static struct vfs_node *
+initrd_image_mount(void *addr, size_t len)
+{
+	struct initrd_image_header *ih = addr;
+
+	if (ih->ih_version != INITRD_IMAGE_VERSION || ih->ih_size > len ||
+	    ih->ih_nnodes == 0 ||
+	    ih->ih_nodes > ih->ih_size || ih->ih_nnodes >
+	    (ih->ih_size - ih->ih_nodes) / sizeof(struct initrd_image_node) ||
+	    ih->ih_hash > ih->ih_size || ih->ih_nhash >
+	    (ih->ih_size - ih->ih_hash) / sizeof(uint32_t) ||
+	    (ih->ih_nhash & (ih->ih_nhash - 1)) != 0 ||
+	    ih->ih_nhash <= ih->ih_nnodes ||
+	    ih->ih_strtab > ih->ih_size || ih->ih_strsiz == 0 ||
+	    ih->ih_strsiz > ih->ih_size - ih->ih_strtab ||
+	    ((char *)addr)[ih->ih_strtab + ih->ih_strsiz - 1] != '\0')
+		PANIC("initrd: bad image");
+
+	initrd_image  = addr;
+	initrd_inodes = (void *)(initrd_image + ih->ih_nodes);
+	initrd_ihash  = (void *)(initrd_image + ih->ih_hash);
+	return (initrd_image_vnode(0));
 }
 
 struct vfs_node *
-init_initrd(void *addr)
+init_initrd(void *addr, size_t len)
 {
-	// Initialise the root directory.
-	initrd_root = kmalloc(sizeof(struct vfs_node));
-	memcpy(initrd_root->name, "initrd", 7);
-	initrd_root->mask = initrd_root->uid = initrd_root->gid = initrd_root->inode = initrd_root->length = 0;
-	initrd_root->flags = VFS_DIRECTORY;
-	initrd_root->read = 0;
-	initrd_root->write = 0;
-	initrd_root->open = 0;
-	initrd_root->close = 0;
-	initrd_root->readdir = &initrd_readdir;
-	initrd_root->finddir = &initrd_finddir;
-	initrd_root->ptr = 0;
-	initrd_root->impl = 0;
-
-	// Initialise the /dev directory (required!)
-	initrd_dev = kmalloc(sizeof(struct vfs_node));
-	memcpy(initrd_dev->name, "dev", 4);
-	initrd_dev->mask = initrd_dev->uid = initrd_dev->gid = initrd_dev->inode = initrd_dev->length = 0;
-	initrd_dev->flags = VFS_DIRECTORY;
-	initrd_dev->read = 0;
-	initrd_dev->write = 0;
-	initrd_dev->open = 0;
-	initrd_dev->close = 0;
-	initrd_dev->readdir = &initrd_readdir;
-	initrd_dev->finddir = &initrd_finddir;
-	initrd_dev->ptr = 0;
-	initrd_dev->impl = 0;
-
-	struct tar_file *tf;
-	int x = tar_parse_mem(addr, &tar_files);
-	if (x == -1)
+	struct tar_entry *te, *end;
+	struct initrd_node *in, *target;
+
+	if (len >= sizeof(struct initrd_image_header) &&
+	    ((struct initrd_image_header *)addr)->ih_magic == INITRD_IMAGE_MAGIC)
+		return (initrd_image_mount(addr, len));
+
+	if (tar_parse_mem(addr, len, &initrd_index) == -1)
 		PANIC("tar_parse_mem");
+	end = initrd_index->ti_entries + initrd_index->ti_count;
+
+	/* one slot per entry, plus the root and /dev. */
+	initrd_npool = initrd_index->ti_count + 2;
+	initrd_pool  = kmalloc0(initrd_npool * sizeof(struct initrd_node));
+	if (initrd_pool == NULL)
+		PANIC("initrd: out of memory");
+
+	// Initialise the root directory.
+	initrd_root = initrd_node_alloc(NULL, "initrd", 6, VFS_DIRECTORY);
+	if (initrd_root == NULL)
+		PANIC("initrd: out of memory");
+
+	for (te = initrd_index->ti_entries; te < end; te++) {
+		if (initrd_add(te) == -1)
+			printf("initrd: skipping %s\n", TAR_PATH(initrd_index, te));
+	}
+
+	/*
+	 * Now that the tree is complete, bind the hard links to the data of
+	 * their target and the symlinks to the node they point to, if any.
+	 */
+	for (te = initrd_index->ti_entries; te < end; te++) {
+		if (te->te_type != TAR_HARDLINK && te->te_type != TAR_SYMLINK)
+			continue;
+		in = initrd_resolve(initrd_root, TAR_PATH(initrd_index, te), 0,
+		    0);
+		if (in == NULL || in->in_entry != te)
+			continue; /* replaced by a later entry */
+		if (te->te_type == TAR_SYMLINK) {
+			target = initrd_resolve(in->in_parent,
+			    TAR_LINK(initrd_index, te), 1, 0);
+			if (target != NULL)
+				in->in_vnode.ptr = &target->in_vnode;
+			continue;
+		}
+		target = initrd_resolve(initrd_root, TAR_LINK(initrd_index, te),
+		    1, 0);
+		if (target == NULL || target->in_entry == NULL ||
+		    target->in_entry->te_type != TAR_FILE)
+			continue;
+		in->in_entry = target->in_entry;
+		in->in_vnode.impl   = (uint32_t)target->in_entry;
+		in->in_vnode.length = target->in_entry->te_size;
+	}
+
+	// We also need a /dev directory, so we can mount devfs later on.
+	if (initrd_child(initrd_root, "dev", 3) == NULL &&
+	    initrd_node_alloc(initrd_root, "dev", 3, VFS_DIRECTORY) == NULL)
+		PANIC("initrd: out of memory");
 
-	root_nodes = kmalloc(sizeof(struct vfs_node) * x);
-	nroot_nodes = x;
-
-	// For every file...
-	int i = 0;
-	TAILQ_FOREACH(tf, tar_files, entries) {
-		// Create a new file node.
-		memcpy(root_nodes[i].name, tf->tf_filename, strlen(tf->tf_filename) + 1);
-		root_nodes[i].mask = root_nodes[i].uid = root_nodes[i].gid = 0;
-		root_nodes[i].length = tf->tf_datasiz;
-		root_nodes[i].inode = i;
-		root_nodes[i].flags = VFS_FILE;
-		root_nodes[i].read = &initrd_read;
-		root_nodes[i].write = 0;
-		root_nodes[i].readdir = 0;
-		root_nodes[i].finddir = 0;
-		root_nodes[i].open = 0;
-		root_nodes[i].close = 0;
-		root_nodes[i].impl = 0;
-		i++;
-	}
-	return initrd_root;
+	return (&initrd_root->in_vnode);
 }
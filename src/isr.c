@@ -6,45 +6,239 @@
 #include <common.h>
 #include <monitor.h>
 #include <isr.h>
+#include <clock.h>
+#include <softirq.h>
+#include <apic.h>
+#include <spinlock.h>
+#include <task.h>
 
-isrhdl_t interrupt_handlers[256];
+LIST_HEAD(intr_chain, intr_handler);
 
-/* This gets called from our ASM interrupt handler stub. */
+/*
+ * The chains are modified under intr_lock but walked without it: a handler
+ * must not be disestablished while its interrupt may run on another CPU.
+ */
+static struct intr_chain	intr_chains[256];
+static struct spinlock		intr_lock = SPINLOCK_INITIALIZER("intr");
+struct irq_stat irq_stats[NIRQ];
+
+static void	i8259_eoi(uint32_t irq);
+static void	i8259_mask(uint32_t irq, int masked);
+
+static struct intr_pic i8259_pic = {
+	.ip_name = "8259",
+	.ip_eoi  = &i8259_eoi,
+	.ip_mask = &i8259_mask,
+};
+
+struct intr_pic *intr_pic = &i8259_pic;
+
+
+static uint32_t	irq_stats_read(struct vfs_node *node, uint32_t offset,
+		    uint32_t size, char *buf);
+
+struct vfs_node irq_stats_node = {
+	.name	= "interrupts",
+	.flags	= VFS_CHARDEVICE,
+	.read	= &irq_stats_read,
+};
+
+static int	intr_dispatch(struct cpu_regs *regs);
+static void	isr_handler(struct cpu_regs *regs);
+static void	irq_handler(struct cpu_regs *regs);
+
+
+/*
+ * This gets called from our ASM interrupt handler stub, regs points to the
+ * saved state on the stack.
+ */
 void
-isr_handler(struct cpu_regs regs)
+intr_handler(struct cpu_regs *regs)
 {
 
-	if (interrupt_handlers[regs.int_no] != NULL) {
-		isrhdl_t handler = interrupt_handlers[regs.int_no];
-		handler(regs);
-	} else {
-		(void)printf("unhandled interrupt: %d\n", regs.int_no);
+	if (regs->int_no >= IRQ0 && regs->int_no < IRQ0 + NIRQ)
+		irq_handler(regs);
+	else
+		isr_handler(regs);
+}
+
+/*
+ * Call every handler chained on the vector, return non-zero if one of them
+ * handled the interrupt.
+ */
+static int
+intr_dispatch(struct cpu_regs *regs)
+{
+	struct intr_handler *ih, *next;
+	uint64_t start, cycles;
+	int handled = 0;
+
+	LIST_FOREACH_SAFE(ih, &intr_chains[regs->int_no], ih_link, next) {
+		start = clock_cycles();
+		if (ih->ih_func(regs, ih->ih_cookie) == INTR_HANDLED) {
+			ih->ih_handled++;
+			handled = 1;
+		}
+		cycles = clock_cycles() - start;
+		ih->ih_calls++;
+		ih->ih_cycles += cycles;
+		if (cycles > ih->ih_max)
+			ih->ih_max = cycles;
 	}
+
+	return (handled);
 }
 
-/* This gets called from our ASM interrupt handler stub. */
-void
-irq_handler(struct cpu_regs regs) {
+static void
+i8259_eoi(uint32_t irq)
+{
+
 	/* Send an EOI (end of interrupt) signal to the PICs. If this interrupt
 	   involved the slave. */
-	if (regs.int_no >= 40) {
+	if (irq >= 8) {
 		/* Send reset signal to slave.*/
 		outb(0xA0, 0x20);
 	}
 	/* Send reset signal to master. */
 	outb(0x20, 0x20);
+}
+
+static void
+i8259_mask(uint32_t irq, int masked)
+{
+	uint16_t port = (irq < 8 ? 0x21 : 0xA1);
+	uint8_t bit = 1 << (irq & 0x7);
+
+	if (irq >= NISAIRQ)
+		return;
+	if (masked)
+		outb(port, inb(port) | bit);
+	else
+		outb(port, inb(port) & ~bit);
+}
+
+static void
+isr_handler(struct cpu_regs *regs)
+{
 
-	if (interrupt_handlers[regs.int_no] != 0) {
-		isrhdl_t handler = interrupt_handlers[regs.int_no];
-		handler(regs);
+	if (!intr_dispatch(regs))
+		(void)printf("unhandled interrupt: %d\n", regs->int_no);
+}
+
+static void
+irq_handler(struct cpu_regs *regs) {
+	uint32_t irq = regs->int_no - IRQ0;
+	struct irq_stat *is = &irq_stats[irq];
+	uint64_t start, cycles;
+
+	start = clock_cycles();
+	irq_enter();
+	if (irq < NIOIRQ)
+		intr_pic->ip_eoi(irq);
+	else
+		lapic_eoi();
+
+	if (!intr_dispatch(regs))
+		is->is_stray++;
+
+	/* account the hard IRQ part only, softirqs run in irq_exit(). */
+	cycles = clock_cycles() - start;
+	is->is_count++;
+	is->is_cycles += cycles;
+	if (cycles > is->is_max)
+		is->is_max = cycles;
+	irq_exit();
+	sched_preempt();
+}
+
+void
+intr_establish(uint32_t n, struct intr_handler *ih)
+{
+	struct intr_handler *last;
+	uint32_t eflags;
+
+	if (n >= NELEM(intr_chains))
+		PANIC("Bad interrupt handler index.");
+	ih->ih_calls = ih->ih_handled = ih->ih_cycles = ih->ih_max = 0;
+
+	eflags = spin_lock_irqsave(&intr_lock);
+	if ((last = LIST_FIRST(&intr_chains[n])) == NULL) {
+		LIST_INSERT_HEAD(&intr_chains[n], ih, ih_link);
+	} else {
+		while (LIST_NEXT(last, ih_link) != NULL)
+			last = LIST_NEXT(last, ih_link);
+		LIST_INSERT_AFTER(last, ih, ih_link);
 	}
+	spin_unlock_irqrestore(&intr_lock, eflags);
 }
 
 void
-register_interrupt_handler(uint32_t n, isrhdl_t handler)
+intr_disestablish(uint32_t n, struct intr_handler *ih)
 {
+	uint32_t eflags;
 
-	if (n >= NELEM(interrupt_handlers))
+	if (n >= NELEM(intr_chains))
 		PANIC("Bad interrupt handler index.");
-	interrupt_handlers[n] = handler;
+	eflags = spin_lock_irqsave(&intr_lock);
+	LIST_REMOVE(ih, ih_link);
+	spin_unlock_irqrestore(&intr_lock, eflags);
+}
+
+void
+irq_stats_print(void)
+{
+	char buf[IRQ_STATS_BUFSIZ];
+
+	(void)irq_stats_format(buf, sizeof(buf));
+	(void)printf("%s", buf);
+}
+
+
+size_t
+irq_stats_format(char *buf, size_t size)
+{
+	struct irq_stat *is;
+	struct intr_handler *ih;
+	size_t len = 0;
+	uint32_t i;
+
+	len += snprintf(buf, size,
+	    "IRQ      count   total(ns)     max(ns)      stray\n");
+	for (i = 0; i < NIRQ && len < size; i++) {
+		is = &irq_stats[i];
+		if (is->is_count == 0)
+			continue;
+		len += snprintf(buf + len, size - len,
+		    "%3u %10llu %11llu %11llu %10llu\n",
+		    i, is->is_count, clock_cycles2ns(is->is_cycles),
+		    clock_cycles2ns(is->is_max), is->is_stray);
+		LIST_FOREACH(ih, &intr_chains[IRQ0 + i], ih_link) {
+			if (len >= size)
+				break;
+			len += snprintf(buf + len, size - len,
+			    "    %-10s %10llu %11llu %11llu %10llu\n",
+			    ih->ih_name, ih->ih_calls,
+			    clock_cycles2ns(ih->ih_cycles),
+			    clock_cycles2ns(ih->ih_max), ih->ih_handled);
+		}
+	}
+
+	return (len < size ? len : size - 1);
+}
+
+
+static uint32_t
+irq_stats_read(struct vfs_node *node, uint32_t offset, uint32_t size,
+    char *buf)
+{
+	char text[IRQ_STATS_BUFSIZ];
+	size_t len;
+
+	len = irq_stats_format(text, sizeof(text));
+	if (offset >= len)
+		return (0);
+	if (size > len - offset)
+		size = len - offset;
+	(void)memcpy(buf, text + offset, size);
+	return (size);
 }
@@ -0,0 +1,273 @@
+/*
+ * klog.c -- kernel message buffer (dmesg).
+ *
+ * The ring is indexed by sequence number: record seq lives in the slot
+ * (seq % KLOG_NRECS). A writer reserves seq by incrementing klog_head, marks
+ * the slot busy, copies its text and finally publishes seq in kr_seq. Readers
+ * copy a record out and check kr_seq again afterwards, so a record being
+ * overwritten under their feet is detected and skipped.
+ */
+#include <common.h>
+#include <atomic.h>
+#include <klog.h>
+
+
+/* klog_fetch() results */
+#define	KLOG_FETCH_OK	0
+#define	KLOG_FETCH_LOST	1 /* the record has been overwritten. */
+#define	KLOG_FETCH_BUSY	2 /* the record is not committed yet. */
+
+/* buffer used to turn klog_vprintf() output into records. */
+struct klog_fmtbuf {
+	uint32_t	kf_len;
+	char		kf_text[KLOG_TEXTSIZ];
+};
+
+
+static struct klog_rec	klog_ring[KLOG_NRECS];
+static volatile uint32_t	klog_head;     /* next sequence number. */
+static volatile uint32_t	klog_draining; /* non-zero while draining. */
+static uint32_t		klog_lost;     /* records overwritten before being
+					  output to a sink. */
+static SLIST_HEAD(, klog_sink)	klog_sinks = SLIST_HEAD_INITIALIZER(klog_sinks);
+
+
+static uint32_t	klog_node_read(struct vfs_node *node, uint32_t offset,
+		    uint32_t size, char *buf);
+
+struct vfs_node	klog_node = {
+	.name	= "kmsg",
+	.flags	= VFS_CHARDEVICE,
+	.read	= &klog_node_read,
+};
+
+
+/* sequence number of the oldest record still in the ring. */
+static uint32_t
+klog_oldest(uint32_t head)
+{
+
+	return (head > KLOG_NRECS ? head - KLOG_NRECS : 0);
+}
+
+
+static void
+klog_commit(const char *s, size_t len)
+{
+	uint32_t seq;
+	struct klog_rec *r;
+
+	seq = atomic_fetchadd(&klog_head, 1);
+	r = &klog_ring[seq % KLOG_NRECS];
+	r->kr_seq = KLOG_SEQ_BUSY;
+	barrier();
+	r->kr_len = len;
+	(void)memcpy(r->kr_text, s, len);
+	atomic_store_rel(&r->kr_seq, seq);
+}
+
+
+void
+klog_append(const char *s, size_t len)
+{
+	size_t n;
+
+	while (len > 0) {
+		n = (len > KLOG_TEXTSIZ ? KLOG_TEXTSIZ : len);
+		klog_commit(s, n);
+		s   += n;
+		len -= n;
+	}
+}
+
+
+static void
+klog_fmtbuf_putc(int c, void *arg)
+{
+	struct klog_fmtbuf *kf = arg;
+
+	kf->kf_text[kf->kf_len++] = c;
+	if (kf->kf_len == KLOG_TEXTSIZ) {
+		klog_commit(kf->kf_text, kf->kf_len);
+		kf->kf_len = 0;
+	}
+}
+
+
+int
+klog_vprintf(const char *fmt, va_list ap)
+{
+	struct klog_fmtbuf kf;
+	int ret;
+
+	kf.kf_len = 0;
+	ret = kvprintf(fmt, &klog_fmtbuf_putc, &kf, ap);
+	if (kf.kf_len > 0)
+		klog_commit(kf.kf_text, kf.kf_len);
+
+	return (ret);
+}
+
+
+int
+klog_printf(const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	va_start(ap, fmt);
+	ret = klog_vprintf(fmt, ap);
+	va_end(ap);
+
+	return (ret);
+}
+
+
+/*
+ * Copy the record seq into text (which must be KLOG_TEXTSIZ long) and its
+ * length into *lenp.
+ */
+static int
+klog_fetch(uint32_t seq, char *text, uint32_t *lenp)
+{
+	struct klog_rec *r = &klog_ring[seq % KLOG_NRECS];
+	uint32_t rseq, len;
+
+	rseq = atomic_load_acq(&r->kr_seq);
+	if (rseq != seq) {
+		if (atomic_load_acq(&klog_head) - seq > KLOG_NRECS ||
+		    (rseq != KLOG_SEQ_BUSY && (int32_t)(rseq - seq) > 0))
+			return (KLOG_FETCH_LOST);
+		return (KLOG_FETCH_BUSY);
+	}
+	len = r->kr_len;
+	if (len > KLOG_TEXTSIZ)
+		len = KLOG_TEXTSIZ;
+	(void)memcpy(text, r->kr_text, len);
+	/* check that the record was not recycled while we were copying it. */
+	if (atomic_load_acq(&r->kr_seq) != seq)
+		return (KLOG_FETCH_LOST);
+
+	*lenp = len;
+	return (KLOG_FETCH_OK);
+}
+
+
+/*
+ * Output every committed record to ks. Return non-zero if we stopped on a
+ * record which is not committed yet: its writer will drain again once done.
+ */
+static int
+klog_drain_sink(struct klog_sink *ks)
+{
+	char text[KLOG_TEXTSIZ];
+	uint32_t head, len, i;
+
+	head = atomic_load_acq(&klog_head);
+	while (ks->ks_seq != head) {
+		if (head - ks->ks_seq > KLOG_NRECS) {
+			/* the sink was too slow, skip what has been lost. */
+			klog_lost += head - KLOG_NRECS - ks->ks_seq;
+			ks->ks_seq = head - KLOG_NRECS;
+			continue;
+		}
+		switch (klog_fetch(ks->ks_seq, text, &len)) {
+		case KLOG_FETCH_BUSY:
+			return (1);
+		case KLOG_FETCH_LOST:
+			klog_lost++;
+			break;
+		case KLOG_FETCH_OK:
+			for (i = 0; i < len; i++)
+				ks->ks_putc(text[i]);
+			break;
+		}
+		ks->ks_seq++;
+	}
+
+	return (0);
+}
+
+
+void
+klog_drain(void)
+{
+	struct klog_sink *ks;
+	uint32_t head;
+	int busy, pending;
+
+	do {
+		if (atomic_swap(&klog_draining, 1) != 0)
+			return; /* someone else is draining, it will do our job */
+		busy = 0;
+		SLIST_FOREACH(ks, &klog_sinks, ks_link)
+			busy |= klog_drain_sink(ks);
+		atomic_store_rel(&klog_draining, 0);
+
+		/* records may have been appended after our last check. */
+		pending = 0;
+		head = atomic_load_acq(&klog_head);
+		SLIST_FOREACH(ks, &klog_sinks, ks_link)
+			pending |= (ks->ks_seq != head);
+	} while (!busy && pending);
+}
+
+
+void
+klog_panic(void)
+{
+	struct klog_sink *ks;
+
+	/* the context owning the drain will not come back. */
+	atomic_store_rel(&klog_draining, 0);
+	klog_drain();
+	SLIST_FOREACH(ks, &klog_sinks, ks_link) {
+		if (ks->ks_flush != NULL)
+			ks->ks_flush();
+	}
+}
+
+
+void
+klog_sink_register(struct klog_sink *ks)
+{
+
+	ks->ks_seq = klog_oldest(atomic_load_acq(&klog_head));
+	SLIST_INSERT_HEAD(&klog_sinks, ks, ks_link);
+	klog_drain();
+}
+
+
+uint32_t
+klog_read(uint32_t offset, uint32_t len, char *buf)
+{
+	char text[KLOG_TEXTSIZ];
+	uint32_t seq, head, rlen, n, count = 0;
+
+	head = atomic_load_acq(&klog_head);
+	for (seq = klog_oldest(head); seq != head && count < len; seq++) {
+		if (klog_fetch(seq, text, &rlen) != KLOG_FETCH_OK)
+			continue;
+		if (offset >= rlen) {
+			offset -= rlen;
+			continue;
+		}
+		n = rlen - offset;
+		if (n > len - count)
+			n = len - count;
+		(void)memcpy(buf + count, text + offset, n);
+		count += n;
+		offset = 0;
+	}
+
+	return (count);
+}
+
+
+static uint32_t
+klog_node_read(struct vfs_node *node, uint32_t offset, uint32_t size,
+    char *buf)
+{
+
+	return (klog_read(offset, size, buf));
+}
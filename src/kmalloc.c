@@ -8,13 +8,12 @@
 #include <paging.h>
 #include <heap.h>
 #include <kmalloc.h>
+#include <magazine.h>
 
 // end is defined in the linker script.
 extern uint32_t __end;
 uint32_t placement_address = (uint32_t)&__end;
 
-/* in heap.c */
-extern struct vm_heap *kernel_heap;
 /* in paging.c */
 extern struct vm_page_directory *kernel_directory;
 
@@ -85,6 +84,8 @@ static void *
 _kmalloc(size_t len, uint32_t *phys, uint32_t flags)
 {
 	void *addr = NULL;
+	struct mcs_node mn;
+	uint32_t eflags;
 
 	if (kernel_heap == NULL) {
 		if ((flags & M_ALIGNED) && (placement_address & 0xFFFFF000)) {
@@ -95,8 +96,13 @@ _kmalloc(size_t len, uint32_t *phys, uint32_t flags)
 			*phys = placement_address;
 		placement_address += len;
 		addr = (void *)(placement_address - len);
+	} else if (!(flags & M_ALIGNED) && phys == NULL &&
+	    (addr = mag_alloc(len)) != NULL) {
+		/* served by the CPU caches, without the heap lock. */
 	} else {
+		eflags = mcs_lock_irqsave(&kernel_heap_lock, &mn);
 		addr = alloc(len, (flags & M_ALIGNED), kernel_heap);
+		mcs_unlock_irqrestore(&kernel_heap_lock, &mn, eflags);
 		if (phys != NULL) {
 			struct vm_page *page = get_page((uint32_t)addr, 0, kernel_directory);
 			*phys = page->p_frame * 0x1000 + ((uint32_t)addr & 0xFFF);
@@ -111,6 +117,12 @@ _kmalloc(size_t len, uint32_t *phys, uint32_t flags)
 void
 kfree(void *ptr)
 {
+	struct mcs_node mn;
+	uint32_t eflags;
 
+	if (ptr == NULL || mag_free(ptr) == 0)
+		return;
+	eflags = mcs_lock_irqsave(&kernel_heap_lock, &mn);
 	free(ptr, kernel_heap);
+	mcs_unlock_irqrestore(&kernel_heap_lock, &mn, eflags);
 }
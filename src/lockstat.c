@@ -0,0 +1,104 @@
+/*
+ * lockstat.c -- lock contention statistics.
+ */
+#include <common.h>
+#include <atomic.h>
+#include <lockstat.h>
+
+
+static struct lock_stat * volatile	lockstat_list;
+
+static uint32_t	lockstat_read(struct vfs_node *node, uint32_t offset,
+		    uint32_t size, char *buf);
+
+struct vfs_node lockstat_node = {
+	.name	= "lockstat",
+	.flags	= VFS_CHARDEVICE,
+	.read	= &lockstat_read,
+};
+
+
+void
+lockstat_register(struct lock_stat *ls, const char *name)
+{
+	struct lock_stat *head;
+
+	if (!atomic_cmpset(&ls->ls_listed, 0, 1))
+		return;
+	ls->ls_name = (name != NULL ? name : "unnamed");
+	do {
+		head = lockstat_list;
+		ls->ls_next = head;
+	} while (!atomic_cmpset((volatile uint32_t *)&lockstat_list,
+	    (uint32_t)head, (uint32_t)ls));
+}
+
+
+size_t
+lockstat_format(char *buf, size_t size)
+{
+#ifndef LOCKSTAT
+
+	return (snprintf(buf, size, "lock statistics disabled, build with "
+	    "-DLOCKSTAT\n"));
+#else
+	struct lock_stat *ls, *other, sum;
+	size_t len = 0;
+
+	len += snprintf(buf, size,
+	    "class           acquired  contended   wait(ns)    max(ns)\n");
+	for (ls = lockstat_list; ls != NULL && len < size; ls = ls->ls_next) {
+		/* report a class once, where its first lock is listed. */
+		for (other = lockstat_list; other != ls; other = other->ls_next) {
+			if (strcmp(other->ls_name, ls->ls_name) == 0)
+				break;
+		}
+		if (other != ls)
+			continue;
+		bzero(&sum, sizeof(sum));
+		for (other = ls; other != NULL; other = other->ls_next) {
+			if (strcmp(other->ls_name, ls->ls_name) != 0)
+				continue;
+			sum.ls_acquired  += other->ls_acquired;
+			sum.ls_contended += other->ls_contended;
+			sum.ls_wait      += other->ls_wait;
+			if (other->ls_maxwait > sum.ls_maxwait)
+				sum.ls_maxwait = other->ls_maxwait;
+		}
+		len += snprintf(buf + len, size - len,
+		    "%-12s %11llu %10llu %10llu %10llu\n", ls->ls_name,
+		    sum.ls_acquired, sum.ls_contended,
+		    clock_cycles2ns(sum.ls_wait),
+		    clock_cycles2ns(sum.ls_maxwait));
+	}
+
+	return (len < size ? len : size - 1);
+#endif /* ndef LOCKSTAT */
+}
+
+
+void
+lockstat_print(void)
+{
+	char buf[LOCKSTAT_BUFSIZ];
+
+	(void)lockstat_format(buf, sizeof(buf));
+	(void)printf("%s", buf);
+}
+
+
+static uint32_t
+lockstat_read(struct vfs_node *node, uint32_t offset, uint32_t size,
+    char *buf)
+{
+	char text[LOCKSTAT_BUFSIZ];
+	size_t len;
+
+	len = lockstat_format(text, sizeof(text));
+	if (offset >= len)
+		return (0);
+	if (size > len - offset)
+		size = len - offset;
+	(void)memcpy(buf, text + offset, size);
+	return (size);
+}
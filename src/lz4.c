@@ -0,0 +1,75 @@
+/*
+ * lz4.c -- LZ4 block decoder.
+ *
+ * Every sequence starts with a token: the high nibble is the literal length,
+ * the low nibble the match length minus 4, a nibble of 15 is followed by
+ * bytes to add to it as long as they are 255. The literals come next, then
+ * the little endian 16 bits offset of the match, back in the output. The
+ * last sequence is made of literals only.
+ */
+#include <lz4.h>
+
+
+#define	LZ4_MINMATCH	4
+
+/* read the length continued after a nibble of 15. */
+static int
+lz4_length(const uint8_t **ipp, const uint8_t *iend, size_t *lenp)
+{
+	const uint8_t *ip = *ipp;
+	uint8_t b;
+
+	do {
+		if (ip == iend)
+			return (-1);
+		b = *ip++;
+		if (*lenp + b < *lenp)
+			return (-1);
+		*lenp += b;
+	} while (b == 255);
+	*ipp = ip;
+	return (0);
+}
+
+int
+lz4_decompress(const void *src, size_t srclen, void *dst, size_t dstlen)
+{
+	const uint8_t *ip = src, *iend = ip + srclen, *match;
+	uint8_t *op = dst, *oend = op + dstlen;
+	size_t len, offset;
+	uint8_t token;
+
+	while (ip < iend) {
+		token = *ip++;
+
+		/* literals */
+		len = token >> 4;
+		if (len == 15 && lz4_length(&ip, iend, &len) == -1)
+			return (-1);
+		if (len > (size_t)(iend - ip) || len > (size_t)(oend - op))
+			return (-1);
+		(void)memcpy(op, ip, len);
+		ip += len;
+		op += len;
+		if (ip == iend)
+			break; /* the last sequence */
+
+		/* match */
+		if (iend - ip < 2)
+			return (-1);
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - (uint8_t *)dst))
+			return (-1);
+		len = token & 15;
+		if (len == 15 && lz4_length(&ip, iend, &len) == -1)
+			return (-1);
+		len += LZ4_MINMATCH;
+		if (len > (size_t)(oend - op))
+			return (-1);
+		/* byte per byte: the match may overlap what it writes. */
+		for (match = op - offset; len > 0; len--)
+			*op++ = *match++;
+	}
+	return (op - (uint8_t *)dst);
+}
@@ -0,0 +1,265 @@
+/*
+ * magazine.c -- per-CPU object caches in front of the kernel heap.
+ *
+ * A CPU allocates from its loaded magazine and, once it is empty, from the
+ * previous one if it is full. Only when both are empty it goes to the depot
+ * to trade the empty previous magazine for a full one. Freeing works the
+ * other way around. The previous magazine is therefore always either full or
+ * empty, and a CPU alternating allocations and frees around a magazine
+ * boundary never touches the depot.
+ *
+ * Objects in the caches are heap blocks, their size class is found back from
+ * the heap block size. A cache miss with an empty depot allocates from the
+ * heap, the depot only keeps MAG_DEPOT_MAX full magazines per class and the
+ * objects which don't fit are freed to the heap.
+ */
+#include <common.h>
+#include <magazine.h>
+#include <heap.h>
+#include <cpu.h>
+#include <spinlock.h>
+
+
+struct magazine {
+	SLIST_ENTRY(magazine)	 m_link;
+	uint32_t		 m_rounds; /* objects in m_objs */
+	void			*m_objs[MAG_ROUNDS];
+};
+SLIST_HEAD(maglist, magazine);
+
+/* what a CPU owns for a size class. */
+struct mag_cache {
+	struct magazine	*mc_loaded;
+	struct magazine	*mc_previous;
+	uint64_t	 mc_allocs;
+	uint64_t	 mc_frees;
+	uint64_t	 mc_misses; /* allocations and frees done by the heap */
+};
+
+struct mag_depot {
+	struct spinlock	md_lock;
+	struct maglist	md_full;
+	struct maglist	md_empty;
+	uint32_t	md_nfull;
+	uint64_t	md_exchanges;
+};
+
+
+static const uint32_t	mag_sizes[MAG_NCLASS] = {
+	16, 32, 64, 128, 256, 512, 1024, 2048,
+};
+static struct mag_cache	mag_caches[MAXCPU][MAG_NCLASS];
+static struct mag_depot	mag_depots[MAG_NCLASS] = {
+	[0 ... MAG_NCLASS - 1] = { .md_lock = SPINLOCK_INITIALIZER("depot") },
+};
+
+
+/* smallest class holding len bytes. */
+static int
+mag_class(size_t len)
+{
+	int c;
+
+	for (c = 0; c < MAG_NCLASS - 1 && mag_sizes[c] < len; c++)
+		continue;
+	return (c);
+}
+
+
+static void *
+mag_heap_alloc(size_t len)
+{
+	struct mcs_node mn;
+	uint32_t eflags;
+	void *p;
+
+	eflags = mcs_lock_irqsave(&kernel_heap_lock, &mn);
+	p = alloc(len, 0, kernel_heap);
+	mcs_unlock_irqrestore(&kernel_heap_lock, &mn, eflags);
+	return (p);
+}
+
+
+/* trade the empty magazine m (may be NULL) for a full one. */
+static struct magazine *
+depot_get_full(struct mag_depot *md, struct magazine *m)
+{
+	struct magazine *full;
+
+	spin_lock(&md->md_lock);
+	if ((full = SLIST_FIRST(&md->md_full)) != NULL) {
+		SLIST_REMOVE_HEAD(&md->md_full, m_link);
+		md->md_nfull--;
+		md->md_exchanges++;
+		if (m != NULL)
+			SLIST_INSERT_HEAD(&md->md_empty, m, m_link);
+	}
+	spin_unlock(&md->md_lock);
+	return (full);
+}
+
+
+/*
+ * trade the full magazine m (may be NULL) for an empty one. Return NULL if
+ * the depot already has too many full magazines or no empty one.
+ */
+static struct magazine *
+depot_get_empty(struct mag_depot *md, struct magazine *m)
+{
+	struct magazine *empty = NULL;
+
+	spin_lock(&md->md_lock);
+	if (m == NULL || md->md_nfull < MAG_DEPOT_MAX) {
+		if ((empty = SLIST_FIRST(&md->md_empty)) != NULL) {
+			SLIST_REMOVE_HEAD(&md->md_empty, m_link);
+			md->md_exchanges++;
+			if (m != NULL) {
+				SLIST_INSERT_HEAD(&md->md_full, m, m_link);
+				md->md_nfull++;
+			}
+		}
+	}
+	spin_unlock(&md->md_lock);
+	return (empty);
+}
+
+
+static void
+depot_put_empty(struct mag_depot *md, struct magazine *m)
+{
+
+	spin_lock(&md->md_lock);
+	SLIST_INSERT_HEAD(&md->md_empty, m, m_link);
+	spin_unlock(&md->md_lock);
+}
+
+
+void *
+mag_alloc(size_t len)
+{
+	struct mag_cache *mc;
+	struct magazine *m;
+	uint32_t eflags;
+	void *p = NULL;
+	int c;
+
+	if (len > MAG_MAXSIZE || kernel_heap == NULL)
+		return (NULL);
+	c = mag_class(len);
+
+	eflags = intr_disable();
+	mc = &mag_caches[curcpu()->ci_id][c];
+	mc->mc_allocs++;
+	if (mc->mc_loaded == NULL || mc->mc_loaded->m_rounds == 0) {
+		if (mc->mc_previous != NULL &&
+		    mc->mc_previous->m_rounds == MAG_ROUNDS) {
+			m = mc->mc_previous;
+			mc->mc_previous = mc->mc_loaded;
+			mc->mc_loaded = m;
+		} else if ((m = depot_get_full(&mag_depots[c],
+		    mc->mc_previous)) != NULL) {
+			mc->mc_previous = mc->mc_loaded;
+			mc->mc_loaded = m;
+		}
+	}
+	m = mc->mc_loaded;
+	if (m != NULL && m->m_rounds > 0)
+		p = m->m_objs[--m->m_rounds];
+	else
+		mc->mc_misses++;
+	intr_restore(eflags);
+
+	/* nothing cached, the object will come back to us when freed. */
+	if (p == NULL)
+		p = mag_heap_alloc(mag_sizes[c]);
+	return (p);
+}
+
+
+int
+mag_free(void *p)
+{
+	struct mag_cache *mc;
+	struct mag_depot *md;
+	struct magazine *m;
+	uint32_t eflags;
+	size_t size;
+	int c, tries;
+
+	if (kernel_heap == NULL || (size = alloc_size(p)) < mag_sizes[0])
+		return (-1);
+	/*
+	 * The largest class p can hold, the heap may have given more than
+	 * asked. Don't waste more than half of the block.
+	 */
+	for (c = MAG_NCLASS - 1; mag_sizes[c] > size; c--)
+		continue;
+	if (size >= 2 * mag_sizes[c])
+		return (-1);
+	md = &mag_depots[c];
+
+	for (tries = 0; tries < 2; tries++) {
+		eflags = intr_disable();
+		mc = &mag_caches[curcpu()->ci_id][c];
+		if (mc->mc_loaded == NULL ||
+		    mc->mc_loaded->m_rounds == MAG_ROUNDS) {
+			if (mc->mc_previous != NULL &&
+			    mc->mc_previous->m_rounds == 0) {
+				m = mc->mc_previous;
+				mc->mc_previous = mc->mc_loaded;
+				mc->mc_loaded = m;
+			} else if ((m = depot_get_empty(md,
+			    mc->mc_previous)) != NULL) {
+				mc->mc_previous = mc->mc_loaded;
+				mc->mc_loaded = m;
+			}
+		}
+		m = mc->mc_loaded;
+		if (m != NULL && m->m_rounds < MAG_ROUNDS) {
+			m->m_objs[m->m_rounds++] = p;
+			mc->mc_frees++;
+			intr_restore(eflags);
+			return (0);
+		}
+		intr_restore(eflags);
+
+		/*
+		 * The depot has no empty magazine: make one and retry, unless
+		 * it already keeps enough full ones.
+		 */
+		if (tries > 0 || md->md_nfull >= MAG_DEPOT_MAX ||
+		    (m = mag_heap_alloc(sizeof(struct magazine))) == NULL)
+			break;
+		m->m_rounds = 0;
+		depot_put_empty(md, m);
+	}
+
+	eflags = intr_disable();
+	mag_caches[curcpu()->ci_id][c].mc_misses++;
+	intr_restore(eflags);
+	return (-1);
+}
+
+
+void
+mag_stats_print(void)
+{
+	struct mag_cache *mc;
+	uint64_t allocs, frees, misses;
+	uint32_t i;
+	int c;
+
+	(void)printf("size     allocs      frees     misses  full  exchanges\n");
+	for (c = 0; c < MAG_NCLASS; c++) {
+		allocs = frees = misses = 0;
+		for (i = 0; i < ncpu; i++) {
+			mc = &mag_caches[i][c];
+			allocs += mc->mc_allocs;
+			frees  += mc->mc_frees;
+			misses += mc->mc_misses;
+		}
+		(void)printf("%4u %10llu %10llu %10llu %5u %10llu\n",
+		    mag_sizes[c], allocs, frees, misses, mag_depots[c].md_nfull,
+		    mag_depots[c].md_exchanges);
+	}
+}
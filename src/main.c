@@ -8,33 +8,54 @@
 #include <monitor.h>
 #include <paging.h>
 #include <timer.h>
+#include <clock.h>
 #include <vfs.h>
 #include <initrd.h>
+#include <devfs.h>
+#include <klog.h>
+#include <serial.h>
+#include <softirq.h>
+#include <tasklet.h>
+#include <isr.h>
+#include <apic.h>
+#include <mptable.h>
+#include <cpu.h>
+#include <lockstat.h>
+#include <task.h>
 
 #include <heap.h>
+#include <file.h>
 
 struct multiboot;
 
-void
-vfs_print_content(void)
+static void
+vfs_print_content(void *arg)
 {
 	// list the contents of /
-	int i = 0;
-	struct dirent *node = 0;
-	while (node = vfs_readdir(vfs_root, i)) {
-  		printf("Found file %s", node->name);
-  		struct vfs_node *fsnode = vfs_finddir(vfs_root, node->name);
-
-  		if (VFS_ISDIR(fsnode))
-    			printf("\n\t(directory)\n");
-  		else {
-    			printf("\n\t contents:\n");
-    			char buf[1024 + 1];
-    			uint32_t sz = vfs_read(fsnode, 0, 1024, buf);
-			buf[sz] = '\0';
-      			printf("%s\n", buf);
-  		}
-  		i++;
+	struct dirent ents[4];
+	uint32_t cookie = 0;
+	int i, n;
+	while ((n = vfs_readdir(vfs_root, &cookie, ents, NELEM(ents))) > 0) {
+		for (i = 0; i < n; i++) {
+			printf("Found file %s", ents[i].name);
+			struct vfs_node *fsnode = vfs_finddir(vfs_root,
+			    ents[i].name);
+
+			if (VFS_ISDIR(fsnode))
+				printf("\n\t(directory)\n");
+			else {
+				printf("\n\t contents:\n");
+				char buf[1024 + 1];
+				int32_t sz;
+				int fd = fd_open(fsnode, O_RDONLY);
+				while ((sz = fd_read(fd, buf, 1024)) > 0) {
+					buf[sz] = '\0';
+					printf("%s", buf);
+				}
+				printf("\n");
+				(void)fd_close(fd);
+			}
+		}
 	}
 }
 
@@ -45,12 +66,22 @@ kern_main(struct multiboot *mboot_ptr)
 	extern uint32_t placement_address;
 
 	mon_clear();
+	/* printf() needs the per-CPU data, which is reached through the GDT. */
+	init_descriptor_tables();
+	klog_sink_register(&mon_klog_sink);
 	(void)printf("+ booting.\n");
 
-	(void)printf("+ descriptor tables init...");
-	init_descriptor_tables();
+	(void)printf("+ softirqs...");
+	open_softirq(SOFTIRQ_KLOG, &klog_drain);
+	init_tasklet();
 	printf("OK\n");
 
+	(void)printf("+ serial console...");
+	if (init_serial() == 0)
+		printf("OK\n");
+	else
+		printf("not found\n");
+
 	(void)printf("+ multiboot...");
 	KASSERT("multiboot modules", mboot_ptr->mods_count > 0);
 	uint32_t initrd_start = *((uint32_t *)mboot_ptr->mods_addr);
@@ -62,13 +93,48 @@ kern_main(struct multiboot *mboot_ptr)
 	init_paging();
 	printf("OK\n");
 
+	(void)printf("+ TSC clock...");
+	if (init_clock() == 0)
+		printf("%ukHz\n", clock_khz());
+	else
+		printf("no TSC\n");
+
+	(void)printf("+ APIC...");
+	if (init_apic() == 0)
+		printf("%u CPU(s), timer %ukHz\n", mp_config.mp_ncpu,
+		    lapic_timer_khz());
+	else
+		printf("not found, using the 8259 PICs\n");
+
+	(void)printf("+ timer...");
+	if (lapic_timer_khz() > 0 && clock_khz() > 0)
+		init_timer(TIMER_HZ, TIMER_ONESHOT | TIMER_LAPIC);
+	else
+		init_timer(TIMER_HZ, TIMER_ONESHOT);
+	asm volatile ("sti");
+	printf("OK\n");
+
+	(void)printf("+ tasks...");
+	init_task();
+	printf("OK\n");
+
+	(void)printf("+ SMP...");
+	printf("%u CPU(s) running\n", smp_start());
+
 	(void)printf("+ VFS...");
-	vfs_root = init_initrd((void *)initrd_start);
+	vfs_root = init_initrd((void *)initrd_start, initrd_end - initrd_start);
+	if (vfs_mount(vfs_lookup("/dev"), init_devfs()) == -1)
+		PANIC("can't mount devfs");
+	(void)devfs_register(&klog_node);
+	(void)devfs_register(&serial_node);
+	(void)devfs_register(&irq_stats_node);
+	(void)devfs_register(&lockstat_node);
 	printf("OK\n");
 
-	vfs_print_content();
+	(void)task_create("vfs", &vfs_print_content, NULL);
 
-	PANIC("end of kern_main()");
+	/* from now on, the boot context is the idle task of this CPU. */
+	task_idle();
 	/* NOTREACHED */
 	return (42);
 }
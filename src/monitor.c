@@ -1,4 +1,6 @@
 #include <monitor.h>
+#include <klog.h>
+#include <spinlock.h>
 
 
 #define MON_DEFAULT_ATTR_BYTE	((0/* black */ << 4) | (15/* white */ & 0x0F))
@@ -17,6 +19,14 @@ static uint16_t *video_memory = (uint16_t *)0xB8000;
 // Stores the cursor position.
 static uint8_t cursor_x = 0;
 static uint8_t cursor_y = 0;
+/* protects the cursor and the screen content. */
+static struct spinlock mon_lock = SPINLOCK_INITIALIZER("monitor");
+
+/* The monitor is fed by the kernel message buffer. */
+struct klog_sink mon_klog_sink = {
+	.ks_name = "vga",
+	.ks_putc = &mon_putchar,
+};
 
 
 static void
@@ -63,7 +73,9 @@ void mon_putchar(char c)
 	   the VGA board. */
 	uint16_t attr = attr_byte << 8;
 	uint16_t *location;
+	uint32_t eflags;
 
+	eflags = spin_lock_irqsave(&mon_lock);
 	if (c == 0x08 && cursor_x > 0) {
 		/* Handle a backspace, by moving the cursor back one space */
 		cursor_x--;
@@ -90,16 +102,20 @@ void mon_putchar(char c)
 	}
 	scroll();
 	move_cursor();
+	spin_unlock_irqrestore(&mon_lock, eflags);
 }
 
 
 void
 mon_clear(void)
 {
+	uint32_t eflags;
 	int i;
 
+	eflags = spin_lock_irqsave(&mon_lock);
 	for (i = 0; i < MON_WIDTH * MON_HEIGHT; i++)
 		video_memory[i] = MON_BLANK_CHAR;
 	cursor_x = cursor_y = 0;
 	move_cursor();
+	spin_unlock_irqrestore(&mon_lock, eflags);
 }
@@ -0,0 +1,251 @@
+/*
+ * mptable.c -- Intel MultiProcessor Specification (1.4) tables parser.
+ *
+ * The tables live in the BIOS memory areas, below 1MB, which are identity
+ * mapped like the rest of the kernel low memory.
+ */
+#include <common.h>
+#include <mptable.h>
+
+
+/* MP floating pointer structure */
+struct mp_fps {
+	char		mf_signature[4]; /* "_MP_" */
+	uint32_t	mf_config;       /* configuration table address */
+	uint8_t		mf_length;       /* in 16 bytes units */
+	uint8_t		mf_spec_rev;
+	uint8_t		mf_checksum;
+	uint8_t		mf_feature1;     /* default configuration type */
+	uint8_t		mf_feature2;     /* bit 7: IMCR present */
+	uint8_t		mf_feature3[3];
+} __packed;
+
+/* MP configuration table header */
+struct mp_cth {
+	char		mc_signature[4]; /* "PCMP" */
+	uint16_t	mc_length;
+	uint8_t		mc_spec_rev;
+	uint8_t		mc_checksum;
+	char		mc_oem_id[8];
+	char		mc_product_id[12];
+	uint32_t	mc_oem_table;
+	uint16_t	mc_oem_table_size;
+	uint16_t	mc_entry_count;
+	uint32_t	mc_lapic_addr;
+	uint16_t	mc_ext_length;
+	uint8_t		mc_ext_checksum;
+	uint8_t		mc_reserved;
+} __packed;
+
+#define	MP_ENTRY_CPU		0
+#define	MP_ENTRY_BUS		1
+#define	MP_ENTRY_IOAPIC		2
+#define	MP_ENTRY_IOINTR		3
+#define	MP_ENTRY_LINTR		4
+
+struct mp_entry_cpu {
+	uint8_t		me_type;
+	uint8_t		me_apic_id;
+	uint8_t		me_apic_ver;
+	uint8_t		me_flags; /* bit 0: enabled, bit 1: BSP */
+	uint32_t	me_signature;
+	uint32_t	me_features;
+	uint32_t	me_reserved[2];
+} __packed;
+
+struct mp_entry_bus {
+	uint8_t		me_type;
+	uint8_t		me_bus_id;
+	char		me_bus_type[6]; /* "ISA   ", "PCI   " ... */
+} __packed;
+
+struct mp_entry_ioapic {
+	uint8_t		me_type;
+	uint8_t		me_id;
+	uint8_t		me_ver;
+	uint8_t		me_flags; /* bit 0: enabled */
+	uint32_t	me_addr;
+} __packed;
+
+struct mp_entry_iointr {
+	uint8_t		me_type;
+	uint8_t		me_intr_type; /* 0: vectored interrupt */
+	uint16_t	me_flags;
+	uint8_t		me_src_bus;
+	uint8_t		me_src_irq;
+	uint8_t		me_dst_ioapic; /* I/O APIC ID, 0xFF for all */
+	uint8_t		me_dst_intin;
+} __packed;
+
+#define	MP_CPU_ENABLED	0x1
+#define	MP_CPU_BSP	0x2
+#define	MP_IOAPIC_ENABLED	0x1
+#define	MP_IMCRP	0x80
+
+
+struct mp_config	mp_config;
+
+
+static uint8_t
+mp_checksum(const void *p, size_t len)
+{
+	const uint8_t *b = p;
+	uint8_t sum = 0;
+
+	while (len-- > 0)
+		sum += *b++;
+	return (sum);
+}
+
+
+/* search len bytes from addr for a valid floating pointer structure. */
+static struct mp_fps *
+mp_search(uint32_t addr, size_t len)
+{
+	struct mp_fps *fps;
+	uint32_t p;
+
+	for (p = addr; p + sizeof(struct mp_fps) <= addr + len; p += 16) {
+		fps = (struct mp_fps *)p;
+		if (fps->mf_signature[0] == '_' && fps->mf_signature[1] == 'M' &&
+		    fps->mf_signature[2] == 'P' && fps->mf_signature[3] == '_' &&
+		    mp_checksum(fps, fps->mf_length * 16) == 0)
+			return (fps);
+	}
+	return (NULL);
+}
+
+
+static struct mp_fps *
+mp_find_fps(void)
+{
+	struct mp_fps *fps;
+	uint32_t ebda;
+
+	/* the first KB of the EBDA, its segment is stored at 0x40E. */
+	ebda = *(uint16_t *)0x40E << 4;
+	if (ebda != 0 && (fps = mp_search(ebda, 1024)) != NULL)
+		return (fps);
+	/* the last KB of the base memory. */
+	if ((fps = mp_search(0x9FC00, 1024)) != NULL)
+		return (fps);
+	/* the BIOS ROM. */
+	return (mp_search(0xF0000, 0x10000));
+}
+
+
+static int
+mp_ioapic_index(uint8_t id)
+{
+	uint32_t i;
+
+	for (i = 0; i < mp_config.mp_nioapic; i++) {
+		if (mp_config.mp_ioapics[i].mi_id == id)
+			return (i);
+	}
+	/* 0xFF means "all the I/O APICs", use the first one. */
+	return (id == 0xFF && mp_config.mp_nioapic > 0 ? 0 : -1);
+}
+
+
+int
+mp_probe(void)
+{
+	struct mp_fps *fps;
+	struct mp_cth *cth;
+	uint8_t *p, *end;
+	int isa_bus = -1, idx;
+	uint32_t i;
+
+	if ((fps = mp_find_fps()) == NULL || fps->mf_feature1 != 0 ||
+	    fps->mf_config == 0)
+		return (-1);
+	cth = (struct mp_cth *)fps->mf_config;
+	if (cth->mc_signature[0] != 'P' || cth->mc_signature[1] != 'C' ||
+	    cth->mc_signature[2] != 'M' || cth->mc_signature[3] != 'P' ||
+	    mp_checksum(cth, cth->mc_length) != 0)
+		return (-1);
+
+	bzero(&mp_config, sizeof(mp_config));
+	mp_config.mp_lapic_addr = cth->mc_lapic_addr;
+	mp_config.mp_imcr = (fps->mf_feature2 & MP_IMCRP) != 0;
+	/* without information, ISA IRQs are identity mapped on the first
+	   I/O APIC, edge triggered and active high. */
+	for (i = 0; i < MP_NISAIRQ; i++)
+		mp_config.mp_isa_irqs[i].mr_intin = i;
+
+	/*
+	 * Two passes, since the I/O interrupt entries refer to the buses and
+	 * I/O APICs by ID.
+	 */
+	end = (uint8_t *)cth + cth->mc_length;
+	for (p = (uint8_t *)(cth + 1); p < end; ) {
+		switch (*p) {
+		case MP_ENTRY_CPU: {
+			struct mp_entry_cpu *e = (void *)p;
+			if ((e->me_flags & MP_CPU_ENABLED) &&
+			    mp_config.mp_ncpu < MP_MAXCPU) {
+				struct mp_cpu *c =
+				    &mp_config.mp_cpus[mp_config.mp_ncpu++];
+				c->mc_apic_id = e->me_apic_id;
+				c->mc_bsp = (e->me_flags & MP_CPU_BSP) != 0;
+			}
+			p += sizeof(struct mp_entry_cpu);
+			break;
+		}
+		case MP_ENTRY_BUS: {
+			struct mp_entry_bus *e = (void *)p;
+			if (e->me_bus_type[0] == 'I' && e->me_bus_type[1] == 'S' &&
+			    e->me_bus_type[2] == 'A')
+				isa_bus = e->me_bus_id;
+			p += sizeof(struct mp_entry_bus);
+			break;
+		}
+		case MP_ENTRY_IOAPIC: {
+			struct mp_entry_ioapic *e = (void *)p;
+			if ((e->me_flags & MP_IOAPIC_ENABLED) &&
+			    mp_config.mp_nioapic < MP_MAXIOAPIC) {
+				struct mp_ioapic *io =
+				    &mp_config.mp_ioapics[mp_config.mp_nioapic++];
+				io->mi_id   = e->me_id;
+				io->mi_addr = e->me_addr;
+			}
+			p += sizeof(struct mp_entry_ioapic);
+			break;
+		}
+		case MP_ENTRY_IOINTR:
+		case MP_ENTRY_LINTR:
+			p += sizeof(struct mp_entry_iointr);
+			break;
+		default:
+			return (-1); /* unknown entry, we can't go on. */
+		}
+	}
+
+	for (p = (uint8_t *)(cth + 1); p < end; ) {
+		switch (*p) {
+		case MP_ENTRY_CPU:
+			p += sizeof(struct mp_entry_cpu);
+			break;
+		case MP_ENTRY_IOINTR: {
+			struct mp_entry_iointr *e = (void *)p;
+			if (e->me_intr_type == 0 && e->me_src_bus == isa_bus &&
+			    e->me_src_irq < MP_NISAIRQ &&
+			    (idx = mp_ioapic_index(e->me_dst_ioapic)) != -1) {
+				struct mp_irq *r =
+				    &mp_config.mp_isa_irqs[e->me_src_irq];
+				r->mr_ioapic = idx;
+				r->mr_intin  = e->me_dst_intin;
+				r->mr_flags  = e->me_flags;
+			}
+			p += sizeof(struct mp_entry_iointr);
+			break;
+		}
+		default: /* all the other entries are 8 bytes long. */
+			p += 8;
+			break;
+		}
+	}
+
+	return (mp_config.mp_ncpu > 0 && mp_config.mp_nioapic > 0 ? 0 : -1);
+}
@@ -1,17 +1,29 @@
 #include <paging.h>
 #include <heap.h>
+#include <cpu.h>
+#include <spinlock.h>
 
 /* A bitset of frames - used or free. */
 uint32_t	*frames;
 uint32_t	nframes;
+static struct spinlock	frames_lock = SPINLOCK_INITIALIZER("frames");
 
 /* Defined in kmalloc.c */
 extern uint32_t	placement_address;
 
-/* The kernel's page directory */
+/* The kernel's page directory, each CPU current one is ci_directory. */
 struct vm_page_directory *kernel_directory;
-/* The current page directory */
-struct vm_page_directory *current_directory;
+
+static struct intr_handler page_fault_ih = {
+	.ih_name = "pagefault",
+	.ih_func = &page_fault_handler,
+};
+
+/* page table entry bits missing from struct vm_page. */
+#define	PTE_PRESENT	0x01
+#define	PTE_RW		0x02
+#define	PTE_PWT		0x08 /* write-through */
+#define	PTE_PCD		0x10 /* cache disable */
 
 /* Macros used in the bitset algorithms. */
 #define INDEX_FROM_BIT(a)	((a) / (8 * 4))
@@ -82,16 +94,18 @@ first_frame(void)
 void
 alloc_frame(struct vm_page *p, int is_kernel, int is_writeable)
 {
-	uint32_t idx;
+	uint32_t idx, eflags;
 
 	if (p->p_frame != 0)
 		return; /* Frame was already allocated, return straight away. */
 
+	eflags = spin_lock_irqsave(&frames_lock);
 	idx = first_frame(); /* idx is now the index of the first free frame. */
 	if (idx == -1)
 		PANIC("No free frame.");
 
 	set_frame(idx * 0x1000); /* this frame is now ours! */
+	spin_unlock_irqrestore(&frames_lock, eflags);
 	p->p_present = 1; /* Mark it as present. */
 	p->p_frame = idx;
 	p->p_rw    = (is_writeable) ? 1 : 0; /* Should the page be writeable? */
@@ -103,14 +117,87 @@ alloc_frame(struct vm_page *p, int is_kernel, int is_writeable)
 void
 free_frame(struct vm_page *p)
 {
+	uint32_t eflags;
 
 	if (p->p_frame == 0)
 		return; /* The given page didn't actually have an allocated frame! */
+	eflags = spin_lock_irqsave(&frames_lock);
 	clear_frame(p->p_frame); /* Frame is now free again. */
+	spin_unlock_irqrestore(&frames_lock, eflags);
 	p->p_frame = 0; /* Page now doesn't have a frame. */
 }
 
 
+void *
+map_mmio(uint32_t phys)
+{
+	struct vm_page *p;
+	uint32_t page = phys & ~0xFFF;
+
+	p = get_page(page, 1, kernel_directory);
+	/* not a RAM frame, so it is not tracked in the frames bitset. */
+	*(uint32_t *)p = page | PTE_PCD | PTE_PWT | PTE_RW | PTE_PRESENT;
+	asm volatile ("invlpg (%0)" : : "r" (page) : "memory");
+
+	return ((void *)phys);
+}
+
+
+/*
+ * Is dir loaded on another CPU? Only the local TLB is flushed when changing
+ * a page, there is no shootdown.
+ */
+static int
+dir_live_elsewhere(struct vm_page_directory *dir)
+{
+	struct cpu_info *ci = curcpu();
+	uint32_t i;
+
+	for (i = 0; i < ncpu; i++) {
+		if (&cpus[i] != ci && cpus[i].ci_directory == dir)
+			return (1);
+	}
+	return (0);
+}
+
+
+int
+share_page(uint32_t kva, uint32_t va, struct vm_page_directory *dir)
+{
+	struct vm_page *kp, *p;
+
+	KASSERT("dir is not live on another CPU", !dir_live_elsewhere(dir));
+	kp = get_page(kva, 0, kernel_directory);
+	if (kp == NULL || !kp->p_present)
+		return (-1);
+	p = get_page(va, 1, dir);
+	if (p->p_present)
+		return (-1);
+	p->p_frame   = kp->p_frame;
+	p->p_rw      = 0;
+	p->p_user    = 1;
+	p->p_present = 1;
+	if (dir == curcpu()->ci_directory)
+		asm volatile ("invlpg (%0)" : : "r" (va & ~0xFFF) : "memory");
+	return (0);
+}
+
+
+void
+unshare_page(uint32_t va, struct vm_page_directory *dir)
+{
+	struct vm_page *p;
+
+	KASSERT("dir is not live on another CPU", !dir_live_elsewhere(dir));
+	if ((p = get_page(va, 0, dir)) == NULL)
+		return;
+	p->p_present = 0;
+	p->p_frame   = 0;
+	if (dir == curcpu()->ci_directory)
+		asm volatile ("invlpg (%0)" : : "r" (va & ~0xFFF) : "memory");
+}
+
+
 void
 init_paging(void)
 {
@@ -170,7 +257,7 @@ init_paging(void)
 
 
 	/* Before we enable paging, we must register our page fault handler. */
-	register_interrupt_handler(14, page_fault_handler);
+	intr_establish(14, &page_fault_ih);
 
 	/* Now, enable paging! */
 	switch_page_directory(kernel_directory);
@@ -186,7 +273,7 @@ switch_page_directory(struct vm_page_directory *dir)
 {
 	uint32_t cr0;
 
-	current_directory = dir;
+	curcpu()->ci_directory = dir;
 	asm volatile("mov %0, %%cr3":: "r"(&dir->pd_tblphys));
 	asm volatile("mov %%cr0, %0": "=r"(cr0));
 	cr0 |= 0x80000000; /* Enable paging! */
@@ -214,8 +301,8 @@ get_page(uint32_t address, int create, struct vm_page_directory *dir)
 }
 
 
-void
-page_fault_handler(struct cpu_regs regs)
+int
+page_fault_handler(struct cpu_regs *regs, void *cookie)
 {
 	uint32_t faulting_address;
 	int present, rw, us, reserved, id;
@@ -224,11 +311,11 @@ page_fault_handler(struct cpu_regs regs)
 	asm volatile("mov %%cr2, %0" : "=r" (faulting_address));
 
 	/* The error code gives us details of what happened. */
-	present = !(regs.err_code & 0x1); /* Page not present */
-	rw = regs.err_code & 0x2;         /* Write operation? */
-	us = regs.err_code & 0x4;         /* Processor was in user-mode? */
-	reserved = regs.err_code & 0x8;   /* Overwritten CPU-reserved bits of page entry? */
-	id = regs.err_code & 0x10;        /* Caused by an instruction fetch? */
+	present = !(regs->err_code & 0x1); /* Page not present */
+	rw = regs->err_code & 0x2;         /* Write operation? */
+	us = regs->err_code & 0x4;         /* Processor was in user-mode? */
+	reserved = regs->err_code & 0x8;   /* Overwritten CPU-reserved bits of page entry? */
+	id = regs->err_code & 0x10;        /* Caused by an instruction fetch? */
 
 	/* Output an error message. */
 	(void)printf("Page fault (");
@@ -242,4 +329,6 @@ page_fault_handler(struct cpu_regs regs)
 		(void)printf("reserved ");
 	(void)printf(") at %x\n", faulting_address);
 	PANIC("Page fault");
+	/* NOTREACHED */
+	return (INTR_HANDLED);
 }
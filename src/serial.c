@@ -0,0 +1,194 @@
+/*
+ * serial.c -- 16550 UART driver, used as a kernel log sink.
+ *
+ * Output is queued into a ring which is drained into the 16 bytes transmit
+ * FIFO, either directly by the writer when the transmitter is idle or by the
+ * "transmitter holding register empty" interrupt (IRQ4).
+ */
+#include <common.h>
+#include <isr.h>
+#include <serial.h>
+
+
+/* register offsets from the base port */
+#define	UART_DATA	0 /* RBR / THR, DLL when DLAB is set */
+#define	UART_IER	1 /* interrupt enable, DLM when DLAB is set */
+#define	UART_IIR	2 /* interrupt identification (read) */
+#define	UART_FCR	2 /* FIFO control (write) */
+#define	UART_LCR	3 /* line control */
+#define	UART_MCR	4 /* modem control */
+#define	UART_LSR	5 /* line status */
+
+#define	IER_ETBEI	0x02 /* enable transmitter holding register empty */
+#define	IIR_NOPEND	0x01 /* no interrupt pending */
+#define	IIR_FIFO_MASK	0xC0 /* set when the FIFO are enabled */
+#define	FCR_ENABLE	0x01
+#define	FCR_RCV_RST	0x02
+#define	FCR_XMT_RST	0x04
+#define	FCR_RX_HIGH	0xC0 /* receive trigger level: 14 bytes */
+#define	LCR_8BITS	0x03
+#define	LCR_DLAB	0x80
+#define	MCR_DTR		0x01
+#define	MCR_RTS		0x02
+#define	MCR_IENABLE	0x08 /* OUT2, gates the IRQ line */
+#define	MCR_LOOPBACK	0x10
+#define	LSR_THRE	0x20 /* transmitter holding register empty */
+#define	LSR_TEMT	0x40 /* transmitter empty */
+
+#define	UART_FIFOSIZ	16
+
+
+static char		serial_txbuf[SERIAL_TXBUFSIZ];
+static volatile uint32_t	serial_txhead; /* next slot to fill */
+static volatile uint32_t	serial_txtail; /* next byte to send */
+static uint32_t		serial_fifosiz = 1;
+static int		serial_present;
+
+
+static int	serial_intr(struct cpu_regs *regs, void *cookie);
+static uint32_t	serial_node_write(struct vfs_node *node, uint32_t offset,
+		    uint32_t size, char *buf);
+
+struct klog_sink serial_klog_sink = {
+	.ks_name  = "com1",
+	.ks_putc  = &serial_putc,
+	.ks_flush = &serial_flush,
+};
+
+static struct intr_handler serial_ih = {
+	.ih_name = "com1",
+	.ih_func = &serial_intr,
+};
+
+struct vfs_node serial_node = {
+	.name	= "ttyS0",
+	.flags	= VFS_CHARDEVICE,
+	.write	= &serial_node_write,
+};
+
+
+/*
+ * Move as much of the ring as possible into the transmit FIFO. Must be called
+ * with interrupts disabled.
+ */
+static void
+serial_start(void)
+{
+	uint32_t n;
+
+	if ((inb(COM1_PORT + UART_LSR) & LSR_THRE) == 0)
+		return; /* the FIFO is not empty yet, IRQ4 will call us back. */
+	for (n = 0; n < serial_fifosiz && serial_txtail != serial_txhead; n++) {
+		outb(COM1_PORT + UART_DATA,
+		    serial_txbuf[serial_txtail % SERIAL_TXBUFSIZ]);
+		serial_txtail++;
+	}
+}
+
+
+static void
+serial_enqueue(char c)
+{
+	uint32_t eflags;
+
+	eflags = intr_disable();
+	while (serial_txhead - serial_txtail == SERIAL_TXBUFSIZ) {
+		/* the ring is full, we have no choice but to wait. */
+		serial_start();
+	}
+	serial_txbuf[serial_txhead % SERIAL_TXBUFSIZ] = c;
+	serial_txhead++;
+	serial_start();
+	intr_restore(eflags);
+}
+
+
+void
+serial_putc(char c)
+{
+
+	if (!serial_present)
+		return;
+	if (c == '\n')
+		serial_enqueue('\r');
+	serial_enqueue(c);
+}
+
+
+void
+serial_flush(void)
+{
+	uint32_t eflags;
+
+	if (!serial_present)
+		return;
+	eflags = intr_disable();
+	while (serial_txtail != serial_txhead)
+		serial_start();
+	while ((inb(COM1_PORT + UART_LSR) & LSR_TEMT) == 0)
+		;
+	intr_restore(eflags);
+}
+
+
+static int
+serial_intr(struct cpu_regs *regs, void *cookie)
+{
+	uint8_t iir;
+
+	if (inb(COM1_PORT + UART_IIR) & IIR_NOPEND)
+		return (INTR_STRAY); /* not us, the line may be shared */
+	/* reading IIR acknowledge a THRE interrupt. */
+	while (((iir = inb(COM1_PORT + UART_IIR)) & IIR_NOPEND) == 0) {
+		/* line status or received data, we don't handle input. */
+		(void)inb(COM1_PORT + UART_LSR);
+		(void)inb(COM1_PORT + UART_DATA);
+	}
+	serial_start();
+	return (INTR_HANDLED);
+}
+
+
+static uint32_t
+serial_node_write(struct vfs_node *node, uint32_t offset, uint32_t size,
+    char *buf)
+{
+	uint32_t i;
+
+	for (i = 0; i < size; i++)
+		serial_putc(buf[i]);
+	return (size);
+}
+
+
+int
+init_serial(void)
+{
+	uint16_t div = 115200 / SERIAL_BAUD;
+
+	outb(COM1_PORT + UART_IER, 0);
+
+	/* check that there is an UART using its loopback mode. */
+	outb(COM1_PORT + UART_MCR, MCR_LOOPBACK);
+	outb(COM1_PORT + UART_DATA, 0xAE);
+	if (inb(COM1_PORT + UART_DATA) != 0xAE)
+		return (-1);
+
+	outb(COM1_PORT + UART_LCR, LCR_DLAB);
+	outb(COM1_PORT + UART_DATA, div & 0xFF);
+	outb(COM1_PORT + UART_IER, div >> 8);
+	outb(COM1_PORT + UART_LCR, LCR_8BITS); /* 8N1, clears DLAB */
+
+	outb(COM1_PORT + UART_FCR,
+	    FCR_ENABLE | FCR_RCV_RST | FCR_XMT_RST | FCR_RX_HIGH);
+	if ((inb(COM1_PORT + UART_IIR) & IIR_FIFO_MASK) == IIR_FIFO_MASK)
+		serial_fifosiz = UART_FIFOSIZ; /* 16550A, working FIFO */
+
+	outb(COM1_PORT + UART_MCR, MCR_DTR | MCR_RTS | MCR_IENABLE);
+	intr_establish(IRQ4, &serial_ih);
+	outb(COM1_PORT + UART_IER, IER_ETBEI);
+
+	serial_present = 1;
+	klog_sink_register(&serial_klog_sink);
+	return (0);
+}
@@ -0,0 +1,106 @@
+/*
+ * softirq.c -- deferred interrupt work (bottom halves).
+ *
+ * The pending mask and the nesting state are per-CPU, a softirq runs on the
+ * CPU which raised it.
+ */
+#include <common.h>
+#include <softirq.h>
+#include <cpu.h>
+
+
+/* how many times do_softirq() restarts before leaving the rest for later. */
+#define	SOFTIRQ_RESTART	10
+
+
+static softirq_func_t	softirq_vec[NSOFTIRQ];
+
+
+void
+open_softirq(uint32_t nr, softirq_func_t func)
+{
+
+	KASSERT("valid softirq", nr < NSOFTIRQ);
+	softirq_vec[nr] = func;
+}
+
+
+void
+raise_softirq(uint32_t nr)
+{
+	uint32_t eflags;
+
+	eflags = intr_disable();
+	curcpu()->ci_softirq_pending |= (1 << nr);
+	intr_restore(eflags);
+}
+
+
+/* called with interrupts disabled, return with interrupts disabled. */
+static void
+do_softirq(void)
+{
+	struct cpu_info *ci = curcpu();
+	uint32_t pending, nr;
+	int restart = SOFTIRQ_RESTART;
+
+	ci->ci_softirq_running = 1;
+	while ((pending = ci->ci_softirq_pending) != 0 && restart-- > 0) {
+		ci->ci_softirq_pending = 0;
+		asm volatile ("sti");
+		for (nr = 0; pending != 0; nr++, pending >>= 1) {
+			if ((pending & 1) && softirq_vec[nr] != NULL)
+				softirq_vec[nr]();
+		}
+		asm volatile ("cli");
+	}
+	ci->ci_softirq_running = 0;
+}
+
+
+void
+irq_enter(void)
+{
+
+	curcpu()->ci_irq_nesting++;
+}
+
+
+void
+irq_exit(void)
+{
+	struct cpu_info *ci = curcpu();
+
+	ci->ci_irq_nesting--;
+	if (ci->ci_irq_nesting == 0 && !ci->ci_softirq_running &&
+	    ci->ci_softirq_pending != 0)
+		do_softirq();
+}
+
+
+void
+softirq_poll(void)
+{
+	struct cpu_info *ci = curcpu();
+
+	if (ci->ci_irq_nesting == 0 && !ci->ci_softirq_running &&
+	    ci->ci_softirq_pending != 0)
+		do_softirq();
+}
+
+
+int
+in_irq(void)
+{
+
+	return (curcpu()->ci_irq_nesting > 0);
+}
+
+
+int
+in_interrupt(void)
+{
+	struct cpu_info *ci = curcpu();
+
+	return (ci->ci_irq_nesting > 0 || ci->ci_softirq_running);
+}
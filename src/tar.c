@@ -6,6 +6,8 @@
 #include <tar.h>
 
 
+#define	TAR_BLOCKSIZ	512
+
 /*
  * see
  * http://en.wikipedia.org/wiki/Tar_(computing)#File_header,
@@ -20,57 +22,313 @@ struct tar_header {
 	char mtime[12];
 	char chksum[8];
 	char typeflag[1];
+	char linkname[100];
+	char magic[6];     /* "ustar", then the fields below are valid */
+	char version[2];
+	char uname[32];
+	char gname[32];
+	char devmajor[8];
+	char devminor[8];
+	char prefix[155];  /* prepended to filename with a '/' */
+};
+
+/* what the GNU and pax meta entries say about the next entry. */
+struct tar_pending {
+	char		*tp_path;
+	char		*tp_link;
+	size_t		 tp_size;
+	int		 tp_hassize;
 };
 
 
-static unsigned int
-getsize(const char *in)
+static size_t
+tar_strnlen(const char *s, size_t len)
 {
-    unsigned int size = 0;
-    unsigned int j;
-    unsigned int count = 1;
- 
-    for (j = 11; j > 0; j--, count *= 8)
-        size += ((in[j - 1] - '0') * count);
- 
-    return size;
- 
+	size_t n;
+
+	for (n = 0; n < len && s[n] != '\0'; n++)
+		continue;
+	return (n);
 }
 
-int
-tar_parse_mem(void *addr, struct tar_fileQ **q_p)
+/*
+ * Parse the numeric field f, either octal (maybe space or NUL padded) or
+ * base-256 (big endian, first bit set) as GNU tar writes large sizes.
+ * Return -1 if it does not fit in a size_t.
+ */
+static int
+tar_number(const char *f, size_t len, size_t *valp)
 {
-	char *p = addr;
-	struct tar_fileQ *q;
-	int i;
+	size_t v = 0, i = 0;
 
-	q = kmalloc0(sizeof(struct tar_fileQ));
-	if (q == NULL)
-		return -1;
-	TAILQ_INIT(q);
-	for (i = 0; ; i++) {
+	if ((uint8_t)f[0] & 0x80) {
+		if ((uint8_t)f[0] & 0x40)
+			return (-1); /* negative */
+		v = (uint8_t)f[0] & 0x3F;
+		for (i = 1; i < len; i++) {
+			if (v > ((size_t)-1 >> 8))
+				return (-1);
+			v = (v << 8) | (uint8_t)f[i];
+		}
+	} else {
+		while (i < len && f[i] == ' ')
+			i++;
+		for (; i < len && f[i] >= '0' && f[i] <= '7'; i++) {
+			if (v > ((size_t)-1 >> 3))
+				return (-1);
+			v = (v << 3) | (f[i] - '0');
+		}
+	}
+	*valp = v;
+	return (0);
+}
+
+static int
+tar_keyis(const char *key, size_t len, const char *s)
+{
+
+	return (tar_strnlen(s, len + 1) == len && memcmp(key, s, len) == 0);
+}
+
+/*
+ * Apply the pax extended header records of data we know about. Values are
+ * terminated in place, over their trailing newline, so that a second pass
+ * finds them terminated already. Return -1 if a number does not fit in a
+ * size_t.
+ */
+static int
+tar_pax(char *data, size_t len, struct tar_pending *tp)
+{
+	char *p = data, *end = data + len, *q, *key, *val;
+	size_t reclen, n;
+
+	while (p < end) {
+		reclen = 0;
+		for (q = p; q < end && *q >= '0' && *q <= '9'; q++) {
+			if (reclen > ((size_t)-1 - 9) / 10)
+				return (-1);
+			reclen = reclen * 10 + (*q - '0');
+		}
+		if (q == end || *q != ' ' || reclen > (size_t)(end - p) ||
+		    p + reclen <= q + 1)
+			return (0);
+		key = q + 1;
+		for (val = key; val < p + reclen && *val != '='; val++)
+			continue;
+		if (val >= p + reclen - 1 ||
+		    (p[reclen - 1] != '\n' && p[reclen - 1] != '\0'))
+			return (0);
+		n = val - key;
+		val++;
+		p[reclen - 1] = '\0';
+
+		if (tar_keyis(key, n, "path"))
+			tp->tp_path = val;
+		else if (tar_keyis(key, n, "linkpath"))
+			tp->tp_link = val;
+		else if (tar_keyis(key, n, "size")) {
+			tp->tp_size = 0;
+			for (q = val; *q >= '0' && *q <= '9'; q++) {
+				if (tp->tp_size > ((size_t)-1 - 9) / 10)
+					return (-1);
+				tp->tp_size = tp->tp_size * 10 + (*q - '0');
+			}
+			tp->tp_hassize = 1;
+		}
+		p += reclen;
+	}
+	return (0);
+}
+
+/*
+ * Strip the leading "/" and "./" and the trailing '/' of path, in place, and
+ * return where it now starts. Old archives mark directories with a trailing
+ * '/' only, so a file with one becomes a directory.
+ */
+static char *
+tar_cleanpath(char *path, uint32_t *typep)
+{
+	size_t len;
+
+	for (;;) {
+		if (path[0] == '/')
+			path++;
+		else if (path[0] == '.' && path[1] == '/')
+			path += 2;
+		else
+			break;
+	}
+	if (path[0] == '.' && path[1] == '\0')
+		path++;
+	len = strlen(path);
+	if (len > 0 && path[len - 1] == '/' && *typep == TAR_FILE)
+		*typep = TAR_DIR;
+	while (len > 0 && path[len - 1] == '/')
+		path[--len] = '\0';
+	return (path);
+}
+
+/*
+ * Fill te for the entry whose header is h. Paths and link targets which are
+ * not already NUL terminated in the archive (pax or GNU meta entries) are
+ * written over h, whose fields have been read by now. Return 0 if the entry
+ * is the archive root ("./"), which is not indexed.
+ */
+static int
+tar_entry_set(char *base, struct tar_header *h, struct tar_pending *tp,
+    uint32_t type, struct tar_entry *te)
+{
+	char buf[sizeof(h->prefix) + 1 + sizeof(h->filename) + 1 +
+	    sizeof(h->linkname) + 1];
+	char *path, *link = NULL;
+	size_t n = 0, len, linkoff = 0;
+
+	if (tp->tp_path == NULL) {
+		if (memcmp(h->magic, "ustar", 5) == 0) {
+			len = tar_strnlen(h->prefix, sizeof(h->prefix));
+			(void)memcpy(buf, h->prefix, len);
+			n = len;
+			if (len > 0)
+				buf[n++] = '/';
+		}
+		len = tar_strnlen(h->filename, sizeof(h->filename));
+		(void)memcpy(buf + n, h->filename, len);
+		n += len;
+		buf[n++] = '\0';
+	}
+	if ((type == TAR_SYMLINK || type == TAR_HARDLINK) && tp->tp_link == NULL) {
+		linkoff = n;
+		len = tar_strnlen(h->linkname, sizeof(h->linkname));
+		(void)memcpy(buf + n, h->linkname, len);
+		n += len;
+		buf[n++] = '\0';
+	}
+	if (n > 0)
+		(void)memcpy(h, buf, n);
+
+	path = (tp->tp_path != NULL ? tp->tp_path : (char *)h);
+	if (type == TAR_SYMLINK || type == TAR_HARDLINK)
+		link = (tp->tp_link != NULL ? tp->tp_link : (char *)h + linkoff);
+	path = tar_cleanpath(path, &type);
+
+	te->te_path = path - base;
+	te->te_link = (link != NULL ? link - base : 0);
+	te->te_type = type;
+	te->te_data = 0;
+	te->te_size = 0;
+	return (path[0] != '\0');
+}
+
+/*
+ * Walk the len bytes archive at base. Fill ti if not NULL, else only count
+ * the entries, the archive root included, touching nothing but the pax
+ * records. Return the number of entries, or -1 on error.
+ */
+static int
+tar_walk(char *base, size_t len, struct tar_index *ti)
+{
+	char *p = base, *end = base + len, *data;
+	struct tar_entry *te;
+	struct tar_pending tp;
+	uint32_t n = 0;
+	int type;
+
+	bzero(&tp, sizeof(tp));
+	while (end - p >= TAR_BLOCKSIZ) {
 		struct tar_header *header = (void *)p;
 		size_t siz;
-		struct tar_file *tf = NULL;
 
 		if (header->filename[0] == '\0') {
 			/* we hit the end of the tarball */
 			break;
 		}
-
-		siz = getsize(header->size);
-		tf = kmalloc0(sizeof(struct tar_file));
-		if (tf == NULL)
+		if (tar_number(header->size, sizeof(header->size), &siz) == -1)
 			return -1;
-		(void)memcpy(tf->tf_filename, header->filename, 100);
-		tf->tf_datasiz = siz;
-		tf->tf_data = ((char *)header) + 512;
-		TAILQ_INSERT_TAIL(q, tf, entries);
-
-		p += ((siz / 512) + 1) * 512;
-		if (siz % 512)
-			p += 512;
+		data = p + TAR_BLOCKSIZ;
+
+		type = -1;
+		switch (header->typeflag[0]) {
+		case 'L': /* GNU long name of the next entry */
+			if (siz > 0 && siz <= (size_t)(end - data) &&
+			    data[siz - 1] == '\0')
+				tp.tp_path = data;
+			break;
+		case 'K': /* GNU long link target of the next entry */
+			if (siz > 0 && siz <= (size_t)(end - data) &&
+			    data[siz - 1] == '\0')
+				tp.tp_link = data;
+			break;
+		case 'x': /* pax extended header of the next entry */
+			if (siz <= (size_t)(end - data) &&
+			    tar_pax(data, siz, &tp) == -1)
+				return -1;
+			break;
+		case '0':
+		case '\0':
+		case '7':
+			type = TAR_FILE;
+			break;
+		case '1':
+			type = TAR_HARDLINK;
+			break;
+		case '2':
+			type = TAR_SYMLINK;
+			break;
+		case '5':
+			type = TAR_DIR;
+			break;
+		default:
+			/* devices, fifos... and their meta entries */
+			bzero(&tp, sizeof(tp));
+			break;
+		}
+
+		if (type != -1) {
+			if (tp.tp_hassize)
+				siz = tp.tp_size;
+			if (siz > (size_t)(end - data)) {
+				/* truncated */
+				return -1;
+			}
+			te = (ti != NULL ? &ti->ti_entries[n] : NULL);
+			if (te == NULL)
+				n++;
+			else if (tar_entry_set(base, header, &tp, type, te)) {
+				if (te->te_type == TAR_FILE) {
+					te->te_data = data - base;
+					te->te_size = siz;
+				}
+				n++;
+			}
+			bzero(&tp, sizeof(tp));
+		}
+
+		if (siz > (size_t)(end - data))
+			break;
+		p = data + ((siz + TAR_BLOCKSIZ - 1) / TAR_BLOCKSIZ) * TAR_BLOCKSIZ;
+	}
+	return n;
+}
+
+int
+tar_parse_mem(void *addr, size_t len, struct tar_index **ti_p)
+{
+	struct tar_index *ti;
+	int max, n;
+
+	/* count the entries first, the table is sized by them. */
+	if ((max = tar_walk(addr, len, NULL)) == -1)
+		return -1;
+	ti = kmalloc(sizeof(struct tar_index) + max * sizeof(struct tar_entry));
+	if (ti == NULL)
+		return -1;
+	ti->ti_base = addr;
+	ti->ti_entries = (struct tar_entry *)(ti + 1);
+	if ((n = tar_walk(addr, len, ti)) == -1) {
+		kfree(ti);
+		return -1;
 	}
-	*q_p = q;
-	return i;
+	ti->ti_count = n;
+	*ti_p = ti;
+	return n;
 }
@@ -0,0 +1,340 @@
+/*
+ * task.c -- kernel tasks and the scheduler.
+ *
+ * runq_lock protects the run queue and the task states. It is held across
+ * switch_context() and released by the task we switch to, either on its way
+ * back from sched_switch() or in task_entry() for a new task. That way no
+ * other CPU can pick a task before its context has been saved.
+ */
+#include <common.h>
+#include <atomic.h>
+#include <task.h>
+#include <cpu.h>
+#include <isr.h>
+#include <softirq.h>
+#include <apic.h>
+#include <paging.h>
+#include <spinlock.h>
+#include <file.h>
+
+
+/* in asm/switch.s */
+void	switch_context(uint32_t *save_esp, uint32_t esp);
+
+/* in paging.c */
+extern struct vm_page_directory *kernel_directory;
+
+
+static int	sched_ipi(struct cpu_regs *regs, void *cookie);
+
+static TAILQ_HEAD(, task)	runq = TAILQ_HEAD_INITIALIZER(runq);
+static struct spinlock		runq_lock = SPINLOCK_INITIALIZER("runq");
+static volatile uint32_t	task_nextid;
+static struct timer		sched_timer;  /* armed while tasks wait */
+static uint32_t			sched_slice;  /* in ticks */
+
+static struct intr_handler	sched_ih = {
+	.ih_name = "resched",
+	.ih_func = &sched_ipi,
+};
+
+
+/* ask ci to call the scheduler on its way out of the next interrupt. */
+static void
+sched_resched(struct cpu_info *ci)
+{
+
+	ci->ci_need_resched = 1;
+	if (ci != curcpu())
+		lapic_ipi(ci->ci_apic_id, IRQ_IPI_RESCHED);
+}
+
+
+/*
+ * queue t and wake up an idle CPU to run it, with runq_lock held. The slice
+ * timer is started if t may have to wait for a busy CPU.
+ */
+static void
+task_setrun(struct task *t)
+{
+	struct cpu_info *ci;
+	uint32_t i;
+
+	t->t_state = TASK_RUNNING;
+	TAILQ_INSERT_TAIL(&runq, t, t_runq);
+	if (!sched_timer.tm_pending)
+		timer_add(&sched_timer, sched_slice);
+
+	for (i = 0; i < ncpu; i++) {
+		ci = &cpus[i];
+		if (ci->ci_curtask != NULL && ci->ci_curtask == ci->ci_idle) {
+			sched_resched(ci);
+			break;
+		}
+	}
+}
+
+
+/*
+ * Second half of a switch, run by the task we switched to: release
+ * runq_lock and free the task which exited on this CPU, if any.
+ */
+static void
+sched_finish(void)
+{
+	struct cpu_info *ci = curcpu();
+	struct task *dead;
+
+	dead = ci->ci_zombie;
+	ci->ci_zombie = NULL;
+	spin_unlock(&runq_lock);
+
+	if (dead != NULL) {
+		kfree(dead->t_stack);
+		kfree(dead);
+	}
+}
+
+
+/*
+ * Switch to the next runnable task. Called with interrupts disabled and
+ * runq_lock held, which is released. The current task goes back to the run
+ * queue unless it is sleeping, dead or the idle task. Once nothing waits
+ * the slice timer is stopped, an idle CPU takes no ticks for it.
+ */
+static void
+sched_switch(void)
+{
+	struct cpu_info *ci = curcpu();
+	struct task *prev = ci->ci_curtask, *next;
+
+	ci->ci_need_resched = 0;
+	if (prev->t_state == TASK_RUNNING && prev != ci->ci_idle)
+		TAILQ_INSERT_TAIL(&runq, prev, t_runq);
+	if ((next = TAILQ_FIRST(&runq)) != NULL)
+		TAILQ_REMOVE(&runq, next, t_runq);
+	else
+		next = ci->ci_idle;
+	if (TAILQ_EMPTY(&runq) && sched_timer.tm_pending)
+		timer_cancel(&sched_timer);
+
+	if (next != prev) {
+		ci->ci_curtask = next;
+		next->t_switches++;
+		if (next->t_directory != ci->ci_directory)
+			switch_page_directory(next->t_directory);
+		switch_context(&prev->t_esp, next->t_esp);
+		/* we may be back on another CPU, ci is stale. */
+	}
+	sched_finish();
+}
+
+
+/* where new tasks start, see task_create(). */
+static void
+task_entry(void)
+{
+	struct task *t;
+
+	sched_finish();
+	asm volatile ("sti");
+
+	t = curtask();
+	t->t_func(t->t_arg);
+	task_exit();
+}
+
+
+static void
+task_timeout(void *arg)
+{
+
+	task_wakeup(arg);
+}
+
+
+/*
+ * Give every CPU a new time slice. Slices are not accounted per task: when
+ * some task is waiting, all the CPUs switch at the same time, and the timer
+ * is re-armed for as long as some still wait.
+ */
+static void
+sched_tick(void *arg)
+{
+	struct cpu_info *ci;
+	uint32_t i, eflags;
+
+	eflags = spin_lock_irqsave(&runq_lock);
+	if (!TAILQ_EMPTY(&runq)) {
+		for (i = 0; i < ncpu; i++) {
+			ci = &cpus[i];
+			if (ci->ci_curtask != NULL)
+				sched_resched(ci);
+		}
+		timer_add(&sched_timer, sched_slice);
+	}
+	spin_unlock_irqrestore(&runq_lock, eflags);
+}
+
+
+/* the need for a switch has been set by the sender, see sched_resched(). */
+static int
+sched_ipi(struct cpu_regs *regs, void *cookie)
+{
+
+	return (INTR_HANDLED);
+}
+
+
+void
+init_task(void)
+{
+
+	intr_establish(IRQ_IPI_RESCHED, &sched_ih);
+	task_init_cpu();
+
+	sched_slice = timer_hz() * TASK_SLICE / 1000;
+	if (sched_slice == 0)
+		sched_slice = 1;
+	timer_set(&sched_timer, &sched_tick, NULL);
+}
+
+
+void
+task_init_cpu(void)
+{
+	struct cpu_info *ci = curcpu();
+	struct task *t;
+
+	t = kmalloc0(sizeof(struct task));
+	t->t_id = atomic_fetchadd(&task_nextid, 1);
+	(void)snprintf(t->t_name, sizeof(t->t_name), "idle%u", ci->ci_id);
+	t->t_state = TASK_RUNNING;
+	t->t_directory = ci->ci_directory;
+	ci->ci_idle = t;
+	ci->ci_curtask = t;
+}
+
+
+struct task *
+curtask(void)
+{
+
+	return (curcpu()->ci_curtask);
+}
+
+
+struct task *
+task_create(const char *name, task_func_t func, void *arg)
+{
+	struct task *t;
+	uint32_t *sp, eflags;
+
+	t = kmalloc0(sizeof(struct task));
+	t->t_stack = kmalloc(TASK_STACKSIZ);
+	t->t_id = atomic_fetchadd(&task_nextid, 1);
+	(void)snprintf(t->t_name, sizeof(t->t_name), "%s", name);
+	t->t_directory = kernel_directory;
+	t->t_func = func;
+	t->t_arg  = arg;
+	timer_set(&t->t_timer, &task_timeout, t);
+
+	/* the frame popped by switch_context(), returning into task_entry(). */
+	sp = (uint32_t *)((uint32_t)t->t_stack + TASK_STACKSIZ);
+	*--sp = 0; /* task_entry() return address, it never returns */
+	*--sp = (uint32_t)&task_entry;
+	*--sp = 0; /* ebp */
+	*--sp = 0; /* ebx */
+	*--sp = 0; /* esi */
+	*--sp = 0; /* edi */
+	t->t_esp = (uint32_t)sp;
+
+	eflags = spin_lock_irqsave(&runq_lock);
+	task_setrun(t);
+	spin_unlock_irqrestore(&runq_lock, eflags);
+
+	return (t);
+}
+
+
+void
+task_exit(void)
+{
+	struct cpu_info *ci;
+	struct task *t;
+
+	fd_closeall(curtask());
+	(void)spin_lock_irqsave(&runq_lock);
+	ci = curcpu();
+	t = ci->ci_curtask;
+	KASSERT("the idle task can't exit", t != ci->ci_idle);
+	t->t_state = TASK_DEAD;
+	ci->ci_zombie = t;
+	sched_switch();
+	PANIC("dead task %s was scheduled", t->t_name);
+}
+
+
+void
+task_yield(void)
+{
+	uint32_t eflags;
+
+	eflags = spin_lock_irqsave(&runq_lock);
+	sched_switch();
+	intr_restore(eflags);
+}
+
+
+void
+task_sleep(uint32_t ticks)
+{
+	struct task *t = curtask();
+	uint32_t eflags;
+
+	/* the timer can't wake us up before we are switched out. */
+	eflags = spin_lock_irqsave(&runq_lock);
+	t->t_state = TASK_SLEEPING;
+	timer_add(&t->t_timer, ticks);
+	sched_switch();
+	intr_restore(eflags);
+}
+
+
+void
+task_wakeup(struct task *t)
+{
+	uint32_t eflags;
+
+	eflags = spin_lock_irqsave(&runq_lock);
+	if (t->t_state == TASK_SLEEPING)
+		task_setrun(t);
+	spin_unlock_irqrestore(&runq_lock, eflags);
+}
+
+
+void
+task_idle(void)
+{
+
+	for (;;) {
+		(void)intr_disable();
+		softirq_poll(); /* the log raised outside of interrupts */
+		if (!TAILQ_EMPTY(&runq))
+			task_yield();
+		/* sti only takes effect after hlt, no wakeup can be missed. */
+		asm volatile ("sti; hlt");
+	}
+}
+
+
+void
+sched_preempt(void)
+{
+	struct cpu_info *ci = curcpu();
+
+	if (ci->ci_need_resched && ci->ci_curtask != NULL && !in_interrupt()) {
+		(void)spin_lock_irqsave(&runq_lock);
+		sched_switch();
+	}
+}
@@ -0,0 +1,82 @@
+/*
+ * tasklet.c -- small deferred work items for interrupt handlers.
+ *
+ * The queue is a lock-free LIFO: producers push with a compare-and-set on the
+ * head, the consumer takes the whole list at once with an atomic swap and
+ * reverses it, so tasklets run in the order they were scheduled. Since the
+ * consumer never pops a single element there is no ABA problem.
+ *
+ * Each CPU has its own queue, a tasklet runs on the CPU which scheduled it.
+ */
+#include <common.h>
+#include <atomic.h>
+#include <softirq.h>
+#include <tasklet.h>
+#include <cpu.h>
+
+
+static void
+tasklet_softirq(void)
+{
+	struct tasklet *list, *tl, *next, *prev = NULL;
+
+	list = (struct tasklet *)atomic_swap(
+	    (volatile uint32_t *)&curcpu()->ci_tasklets, (uint32_t)NULL);
+
+	/* reverse to get the scheduling order. */
+	for (tl = list; tl != NULL; tl = next) {
+		next = tl->tl_next;
+		tl->tl_next = prev;
+		prev = tl;
+	}
+
+	for (tl = prev; tl != NULL; tl = next) {
+		next = tl->tl_next;
+		/* unqueue first so that tl_func can schedule it again. */
+		atomic_store_rel(&tl->tl_queued, 0);
+		tl->tl_func(tl->tl_arg);
+	}
+}
+
+
+void
+init_tasklet(void)
+{
+
+	open_softirq(SOFTIRQ_TASKLET, &tasklet_softirq);
+}
+
+
+void
+tasklet_set(struct tasklet *tl, tasklet_func_t func, void *arg)
+{
+
+	tl->tl_next   = NULL;
+	tl->tl_queued = 0;
+	tl->tl_func   = func;
+	tl->tl_arg    = arg;
+}
+
+
+int
+tasklet_schedule(struct tasklet *tl)
+{
+	struct tasklet * volatile *headp;
+	struct tasklet *head;
+	uint32_t eflags;
+
+	if (!atomic_cmpset(&tl->tl_queued, 0, 1))
+		return (0);
+	/* stay on this CPU until the softirq is raised. */
+	eflags = intr_disable();
+	headp = &curcpu()->ci_tasklets;
+	do {
+		head = *headp;
+		tl->tl_next = head;
+	} while (!atomic_cmpset((volatile uint32_t *)headp,
+	    (uint32_t)head, (uint32_t)tl));
+	raise_softirq(SOFTIRQ_TASKLET);
+	intr_restore(eflags);
+
+	return (1);
+}
@@ -1,45 +1,446 @@
 /*
  * timer.c -- Initialises the PIT, and handles clock updates.
  * Written for JamesM's kernel development tutorials.
+ *
+ * The tick interrupt comes from the PIT channel 0 or, in TIMER_LAPIC mode,
+ * from the local APIC timer. In one-shot mode the elapsed time is measured
+ * against a reference counter: the PIT channel 2, or the TSC with the local
+ * APIC timer.
+ *
+ * The wheel and the clock are protected by timer_lock. Only the CPU which
+ * called init_timer() gets the tick interrupt and runs the timers.
+ *
+ * Pending timers are kept in a hierarchical timing wheel: tv1 has one slot
+ * per tick for the next 256 ticks, each slot of tv2 covers 256 ticks, each
+ * slot of tv3 64 times more and so on. Adding or cancelling a timer is O(1),
+ * timers are moved down one level ("cascaded") when the lower level wraps.
  */
 #include <common.h>
 #include <timer.h>
 #include <isr.h>
 #include <monitor.h>
+#include <softirq.h>
+#include <clock.h>
+#include <apic.h>
+#include <cpu.h>
+#include <spinlock.h>
 
 
+#define	TVR_BITS	8
+#define	TVN_BITS	6
+#define	TVR_SIZE	(1 << TVR_BITS)
+#define	TVN_SIZE	(1 << TVN_BITS)
+#define	TVR_MASK	(TVR_SIZE - 1)
+#define	TVN_MASK	(TVN_SIZE - 1)
+/* index in tvn (n >= 2) for the tick t */
+#define	TVN_INDEX(t, n)	\
+	((uint32_t)((t) >> (TVR_BITS + ((n) - 2) * TVN_BITS)) & TVN_MASK)
+
+/*
+ * Longest one-shot we program, in PIT cycles. It must stay well under the
+ * 65536 cycles period of the channel 2 reference counter.
+ */
+#define	PIT_MAXSHOT	0xC000
+
+LIST_HEAD(timer_list, timer);
+
+
+static struct timer_list	tv1[TVR_SIZE];
+static struct timer_list	tv2[TVN_SIZE];
+static struct timer_list	tv3[TVN_SIZE];
+static struct timer_list	tv4[TVN_SIZE];
+static struct timer_list	tv5[TVN_SIZE];
+
+static volatile uint64_t	ticks;      /* the monotonic clock */
+static uint64_t		wheel_time; /* next tick to be run by the wheel */
+static uint32_t		timer_freq;
+static uint32_t		pit_div;    /* PIT cycles per tick */
+static int		timer_oneshot;
+static int		timer_lapic;
+static uint32_t		ref_div;     /* reference cycles per tick */
+static uint32_t		ref_residue; /* reference cycles not yet accounted in
+					ticks */
+static uint16_t		pit_ref;     /* last channel 2 counter value read */
+static uint64_t		tsc_ref;     /* last TSC value read */
+static uint64_t		next_deadline; /* next tick with work for the wheel */
+static struct cpu_info	*timer_cpu;    /* where the tick interrupt goes */
+static struct spinlock	timer_lock = SPINLOCK_INITIALIZER("timer");
+
+static int	timer_callback(struct cpu_regs *regs, void *cookie);
+
+static struct intr_handler timer_ih = {
+	.ih_name = "timer",
+	.ih_func = &timer_callback,
+};
+
+
+static void
+internal_add_timer(struct timer *t)
+{
+	uint64_t expires = t->tm_expires;
+	uint64_t idx = expires - wheel_time;
+	struct timer_list *vec;
+
+	if ((int64_t)idx < 0) {
+		/* already expired, run it on the next tick. */
+		vec = &tv1[wheel_time & TVR_MASK];
+	} else if (idx < TVR_SIZE) {
+		vec = &tv1[expires & TVR_MASK];
+	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
+		vec = &tv2[TVN_INDEX(expires, 2)];
+	} else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS)) {
+		vec = &tv3[TVN_INDEX(expires, 3)];
+	} else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS)) {
+		vec = &tv4[TVN_INDEX(expires, 4)];
+	} else {
+		/*
+		 * Further than the wheel can go: park it in the last tv5 slot
+		 * before wheel_time, it will be cascaded again until due.
+		 */
+		if (idx > 0xFFFFFFFFULL)
+			expires = wheel_time + 0xFFFFFFFFULL;
+		vec = &tv5[TVN_INDEX(expires, 5)];
+	}
+	LIST_INSERT_HEAD(vec, t, tm_link);
+	t->tm_pending = 1;
+}
+
+
+/* re-add every timers from tv[idx] into the lower levels. */
+static uint32_t
+cascade(struct timer_list *tv, uint32_t idx)
+{
+	struct timer *t;
+
+	while ((t = LIST_FIRST(&tv[idx])) != NULL) {
+		LIST_REMOVE(t, tm_link);
+		internal_add_timer(t);
+	}
+	return (idx);
+}
+
+
+/*
+ * Run every timer due up to the current tick. Called with timer_lock held,
+ * it is released while the timer functions run.
+ */
 static void
-timer_callback(struct cpu_regs regs)
+run_timers(uint32_t eflags)
 {
-	static uint32_t tick;
+	struct timer *t;
+	timer_func_t func;
+	void *arg;
+	uint32_t idx;
 
-	(void)printf("Tick: %d\n", ++tick);
+	while (wheel_time <= ticks) {
+		idx = wheel_time & TVR_MASK;
+		if (idx == 0 &&
+		    cascade(tv2, TVN_INDEX(wheel_time, 2)) == 0 &&
+		    cascade(tv3, TVN_INDEX(wheel_time, 3)) == 0 &&
+		    cascade(tv4, TVN_INDEX(wheel_time, 4)) == 0)
+			(void)cascade(tv5, TVN_INDEX(wheel_time, 5));
+		wheel_time++;
+		while ((t = LIST_FIRST(&tv1[idx])) != NULL) {
+			LIST_REMOVE(t, tm_link);
+			t->tm_pending = 0;
+			if (t->tm_period != 0) {
+				t->tm_expires += t->tm_period;
+				internal_add_timer(t);
+			}
+			func = t->tm_func;
+			arg  = t->tm_arg;
+			spin_unlock_irqrestore(&timer_lock, eflags);
+			func(arg);
+			(void)spin_lock_irqsave(&timer_lock);
+		}
+	}
 }
 
-void init_timer(uint32_t freq)
+
+/*
+ * Return the first tick after the current one where the wheel has work to do
+ * (a timer or a cascade), looking at most max ticks ahead.
+ */
+static uint64_t
+next_event(uint32_t max)
+{
+	uint64_t t;
+
+	if (wheel_time <= ticks)
+		return (wheel_time); /* we are late already. */
+	for (t = wheel_time; t < ticks + max; t++) {
+		if ((t & TVR_MASK) == 0 || !LIST_EMPTY(&tv1[t & TVR_MASK]))
+			return (t);
+	}
+	return (ticks + max);
+}
+
+
+/* read the free running channel 2 counter. */
+static uint16_t
+pit_ref_read(void)
+{
+	uint16_t lo, hi;
+
+	outb(PIT_CMD, PIT_CH2_LATCH);
+	lo = inb(PIT_CH2);
+	hi = inb(PIT_CH2);
+	return (lo | (hi << 8));
+}
+
+
+/* one-shot mode: account the time elapsed since the last sync. */
+static void
+timer_sync(void)
+{
+	uint64_t elapsed, now;
+	uint16_t pnow;
+
+	if (timer_lapic) {
+		now = clock_cycles();
+		elapsed = now - tsc_ref;
+		tsc_ref = now;
+	} else {
+		pnow = pit_ref_read();
+		/* the counter counts down. */
+		elapsed = (uint16_t)(pit_ref - pnow);
+		pit_ref = pnow;
+	}
+	ticks += udivmod64(elapsed + ref_residue, ref_div, &ref_residue);
+}
+
+
+/*
+ * Compute the next tick where the wheel has work to do. In one-shot mode,
+ * program channel 0 or the local APIC timer to fire then.
+ */
+static void
+timer_program(void)
+{
+	uint64_t cycles;
+
+	if (!timer_oneshot) {
+		next_deadline = next_event(TVR_SIZE);
+		return;
+	}
+
+	next_deadline = next_event(timer_lapic ?
+	    TVR_SIZE : PIT_MAXSHOT / ref_div);
+	if (next_deadline <= ticks)
+		cycles = 1;
+	else
+		cycles = (next_deadline - ticks) * ref_div;
+	cycles = (cycles > ref_residue ? cycles - ref_residue : 1);
+
+	if (timer_lapic) {
+		/* from TSC cycles to local APIC timer counts. */
+		lapic_timer_oneshot(IRQ_LAPIC_TIMER, (uint32_t)udivmod64(
+		    cycles * lapic_timer_khz(), clock_khz(), NULL));
+		return;
+	}
+
+	outb(PIT_CMD, PIT_CH0_ONESHOT);
+	outb(PIT_CH0, cycles & 0xFF);
+	outb(PIT_CH0, (cycles >> 8) & 0xFF);
+}
+
+
+/*
+ * The tick interrupt only updates the clock, the timers are run by
+ * timer_softirq() once the interrupt is acknowledged.
+ */
+static int
+timer_callback(struct cpu_regs *regs, void *cookie)
+{
+
+	spin_lock(&timer_lock);
+	if (timer_oneshot)
+		timer_sync();
+	else
+		ticks++;
+	if (ticks >= next_deadline)
+		raise_softirq(SOFTIRQ_TIMER);
+	else if (timer_oneshot)
+		timer_program(); /* woken up early, the one-shot is over. */
+	spin_unlock(&timer_lock);
+	return (INTR_HANDLED);
+}
+
+
+static void
+timer_softirq(void)
+{
+	uint32_t eflags;
+
+	eflags = spin_lock_irqsave(&timer_lock);
+	if (timer_oneshot)
+		timer_sync();
+	run_timers(eflags);
+	timer_program();
+	spin_unlock_irqrestore(&timer_lock, eflags);
+}
+
+
+void
+init_timer(uint32_t freq, int flags)
 {
-	uint32_t div;
 	uint8_t lo, hi;
 
-	/* register our timer callback. */
-	register_interrupt_handler(IRQ0, &timer_callback);
+	timer_freq = freq;
+	timer_oneshot = (flags & TIMER_ONESHOT);
+	timer_lapic = (flags & TIMER_LAPIC);
+	timer_cpu = curcpu();
+	open_softirq(SOFTIRQ_TIMER, &timer_softirq);
+
+	if (timer_lapic) {
+		KASSERT("local APIC timer and TSC",
+		    lapic_timer_khz() > 0 && clock_khz() > 0);
+		/* nobody else wants the IRQ0 the BIOS left running. */
+		intr_pic->ip_mask(0, 1);
+		intr_establish(IRQ_LAPIC_TIMER, &timer_ih);
+		if (timer_oneshot) {
+			ref_div = (uint32_t)udivmod64((uint64_t)clock_khz() * 1000,
+			    freq, NULL);
+			tsc_ref = clock_cycles();
+		} else {
+			lapic_timer_periodic(IRQ_LAPIC_TIMER, (uint32_t)udivmod64(
+			    (uint64_t)lapic_timer_khz() * 1000, freq, NULL));
+		}
+		timer_program();
+		return;
+	}
 
 	/*
 	 * The value we send to the PIT is the value to divide it's input clock
 	 * (1193180 Hz) by, to get our required frequency. Important to note is
 	 * that the divisor must be small enough to fit into 16-bits.
 	 */
-	div = 1193180 / freq;
+	KASSERT("PIT divisor fits into 16-bits", freq > PIT_FREQ / 0xFFFF);
+	pit_div = ref_div = PIT_FREQ / freq;
+	if (timer_oneshot)
+		KASSERT("a tick fits in a one-shot", pit_div <= PIT_MAXSHOT);
+
+	/* register our timer callback. */
+	intr_establish(IRQ0, &timer_ih);
+
+	if (timer_oneshot) {
+		/*
+		 * Channel 2 is our time reference: let it count down from
+		 * 65536 forever, with the speaker disconnected.
+		 */
+		outb(PIT_GATE, (inb(PIT_GATE) & ~0x2) | 0x1);
+		outb(PIT_CMD, PIT_CH2_RATE);
+		outb(PIT_CH2, 0);
+		outb(PIT_CH2, 0);
+		pit_ref = pit_ref_read();
+		timer_program();
+		return;
+	}
 
 	/* Send the command byte. */
-	outb(0x43, 0x36);
+	outb(PIT_CMD, PIT_CH0_RATE);
 
 	/* Divisor has to be sent byte-wise, so split here into upper/lower
 	   bytes. */
-	lo = (uint8_t)(div & 0xFF);
-	hi = (uint8_t)((div >> 8) & 0xFF);
+	lo = (uint8_t)(pit_div & 0xFF);
+	hi = (uint8_t)((pit_div >> 8) & 0xFF);
 
 	// Send the frequency divisor.
-	outb(0x40, lo);
-	outb(0x40, hi);
+	outb(PIT_CH0, lo);
+	outb(PIT_CH0, hi);
+	timer_program();
+}
+
+
+uint64_t
+timer_ticks(void)
+{
+	uint64_t now;
+	uint32_t eflags;
+
+	/* a 64-bits read is not atomic on i386. */
+	eflags = spin_lock_irqsave(&timer_lock);
+	if (timer_oneshot)
+		timer_sync();
+	now = ticks;
+	spin_unlock_irqrestore(&timer_lock, eflags);
+
+	return (now);
+}
+
+
+uint32_t
+timer_hz(void)
+{
+
+	return (timer_freq);
+}
+
+
+void
+timer_set(struct timer *t, timer_func_t func, void *arg)
+{
+
+	bzero(t, sizeof(struct timer));
+	t->tm_func = func;
+	t->tm_arg  = arg;
+}
+
+
+static void
+timer_arm(struct timer *t, uint32_t delay, uint32_t period)
+{
+	uint32_t eflags;
+
+	eflags = spin_lock_irqsave(&timer_lock);
+	if (t->tm_pending)
+		LIST_REMOVE(t, tm_link);
+	if (timer_oneshot)
+		timer_sync();
+	t->tm_expires = ticks + delay;
+	t->tm_period  = period;
+	internal_add_timer(t);
+	/* reprogram the PIT if we are due before what it is waiting for. */
+	if (t->tm_expires < next_deadline) {
+		if (!timer_oneshot)
+			next_deadline = t->tm_expires;
+		else if (curcpu() == timer_cpu)
+			timer_program();
+		else if (timer_lapic) {
+			/* an early tick makes the timer CPU reprogram itself. */
+			lapic_ipi(timer_cpu->ci_apic_id, IRQ_LAPIC_TIMER);
+		}
+	}
+	spin_unlock_irqrestore(&timer_lock, eflags);
+}
+
+
+void
+timer_add(struct timer *t, uint32_t delay)
+{
+
+	timer_arm(t, delay, 0);
+}
+
+
+void
+timer_add_periodic(struct timer *t, uint32_t period)
+{
+
+	KASSERT("non-zero period", period > 0);
+	timer_arm(t, period, period);
+}
+
+
+void
+timer_cancel(struct timer *t)
+{
+	uint32_t eflags;
+
+	eflags = spin_lock_irqsave(&timer_lock);
+	if (t->tm_pending) {
+		LIST_REMOVE(t, tm_link);
+		t->tm_pending = 0;
+	}
+	spin_unlock_irqrestore(&timer_lock, eflags);
 }
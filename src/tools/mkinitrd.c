@@ -0,0 +1,458 @@
+/*
+ * mkinitrd.c -- build a prebuilt initrd image (see include/initrd_image.h)
+ * out of a directory tree. Runs on the host:
+ *
+ *	mkinitrd [-z] root/ initrd.img
+ *
+ * Regular files, directories and symlinks are stored, anything else is
+ * skipped. Hard links share their data. A /dev directory is added when the
+ * tree has none, for devfs to be mounted on.
+ *
+ * With -z, the files are LZ4 compressed (when that makes them smaller) and
+ * packed one after the other instead of page aligned.
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/initrd_image.h"
+
+
+struct ent {
+	char		*e_name;
+	char		*e_path;   /* on the host, NULL if made up */
+	uint32_t	 e_type;
+	uint32_t	 e_size;
+	char		*e_link;   /* symlinks */
+	dev_t		 e_dev;     /* hard links are found by these */
+	ino_t		 e_ino;
+	nlink_t		 e_nlink;
+	struct ent	*e_parent;
+	struct ent	**e_children;
+	uint32_t	 e_nchildren;
+	uint32_t	 e_id;      /* node number */
+	uint32_t	 e_data;    /* image offset of the data */
+	uint8_t		*e_buf;     /* the data to store, NULL if shared */
+	uint32_t	 e_csize;   /* compressed size of e_buf, or 0 */
+};
+
+
+static const char	*progname;
+
+
+static void
+die(const char *fmt, const char *arg)
+{
+
+	(void)fprintf(stderr, "%s: ", progname);
+	(void)fprintf(stderr, fmt, arg);
+	if (errno != 0)
+		(void)fprintf(stderr, ": %s", strerror(errno));
+	(void)fprintf(stderr, "\n");
+	exit(1);
+}
+
+static void
+usage(void)
+{
+
+	(void)fprintf(stderr, "usage: %s [-z] dir image\n", progname);
+	exit(1);
+}
+
+static void *
+xcalloc(size_t n, size_t size)
+{
+	void *p;
+
+	if ((p = calloc(n, size)) == NULL)
+		die("%s", "out of memory");
+	return (p);
+}
+
+static char *
+xstrdup(const char *s)
+{
+	char *p;
+
+	if ((p = strdup(s)) == NULL)
+		die("%s", "out of memory");
+	return (p);
+}
+
+static int
+ent_cmp(const void *a, const void *b)
+{
+
+	return (strcmp((*(struct ent * const *)a)->e_name,
+	    (*(struct ent * const *)b)->e_name));
+}
+
+static void
+ent_add(struct ent *dir, struct ent *e)
+{
+
+	dir->e_children = realloc(dir->e_children,
+	    (dir->e_nchildren + 1) * sizeof(*dir->e_children));
+	if (dir->e_children == NULL)
+		die("%s", "out of memory");
+	dir->e_children[dir->e_nchildren++] = e;
+	e->e_parent = dir;
+}
+
+/* read the tree at dir->e_path into dir. */
+static void
+scan(struct ent *dir)
+{
+	DIR *d;
+	struct dirent *de;
+	struct stat st;
+	struct ent *e;
+	char buf[4096];
+	ssize_t n;
+
+	if ((d = opendir(dir->e_path)) == NULL)
+		die("can't open %s", dir->e_path);
+	while ((errno = 0, de = readdir(d)) != NULL) {
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+			continue;
+		e = xcalloc(1, sizeof(*e));
+		e->e_name = xstrdup(de->d_name);
+		e->e_path = xcalloc(1, strlen(dir->e_path) + 1 +
+		    strlen(de->d_name) + 1);
+		(void)sprintf(e->e_path, "%s/%s", dir->e_path, de->d_name);
+		if (lstat(e->e_path, &st) == -1)
+			die("can't stat %s", e->e_path);
+		e->e_dev = st.st_dev;
+		e->e_ino = st.st_ino;
+		e->e_nlink = st.st_nlink;
+		if (S_ISDIR(st.st_mode)) {
+			e->e_type = INITRD_IMAGE_DIR;
+			scan(e);
+		} else if (S_ISLNK(st.st_mode)) {
+			e->e_type = INITRD_IMAGE_SYMLINK;
+			if ((n = readlink(e->e_path, buf, sizeof(buf) - 1)) == -1)
+				die("can't read link %s", e->e_path);
+			buf[n] = '\0';
+			e->e_link = xstrdup(buf);
+			e->e_size = n;
+		} else if (S_ISREG(st.st_mode)) {
+			if (st.st_size > 0x7fffffff)
+				die("%s is too big", e->e_path);
+			e->e_type = INITRD_IMAGE_FILE;
+			e->e_size = st.st_size;
+		} else {
+			(void)fprintf(stderr, "%s: skipping %s\n", progname,
+			    e->e_path);
+			continue;
+		}
+		ent_add(dir, e);
+	}
+	if (errno != 0)
+		die("can't read %s", dir->e_path);
+	(void)closedir(d);
+	if (dir->e_nchildren > 0)
+		qsort(dir->e_children, dir->e_nchildren,
+		    sizeof(*dir->e_children), &ent_cmp);
+}
+
+static void
+put32(uint8_t *p, uint32_t v)
+{
+
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+}
+
+static uint32_t
+align(uint32_t off)
+{
+
+	return ((off + INITRD_IMAGE_ALIGN - 1) & ~(INITRD_IMAGE_ALIGN - 1));
+}
+
+/* read the e_size bytes of the file e into e_buf. */
+static void
+load(struct ent *e)
+{
+	uint32_t k;
+	ssize_t n;
+	int fd;
+
+	e->e_buf = xcalloc(1, e->e_size);
+	if ((fd = open(e->e_path, O_RDONLY)) == -1)
+		die("can't open %s", e->e_path);
+	for (k = 0; k < e->e_size; k += n) {
+		if ((n = read(fd, e->e_buf + k, e->e_size - k)) <= 0)
+			die("can't read %s", e->e_path);
+	}
+	(void)close(fd);
+}
+
+#define	LZ4_MINMATCH	4
+#define	LZ4_LASTLITERALS 5  /* the block ends with at least these literals */
+#define	LZ4_MFLIMIT	12  /* and no match starts in its last 12 bytes */
+#define	LZ4_HASHLOG	16
+#define	LZ4_BOUND(n)	((n) + (n) / 255 + 16)
+
+static uint32_t
+read32(const uint8_t *p)
+{
+
+	return (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+/* write the length len - base after a nibble of 15, see lz4.c. */
+static uint8_t *
+lz4_length(uint8_t *op, uint32_t len)
+{
+
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return (op);
+}
+
+/* emit a sequence: the literals from lit to ip, then a match if mlen > 0. */
+static uint8_t *
+lz4_sequence(uint8_t *op, const uint8_t *lit, const uint8_t *ip,
+    uint32_t offset, uint32_t mlen)
+{
+	uint32_t llen = ip - lit;
+	uint8_t *token = op++;
+
+	*token = (llen >= 15 ? 15 : llen) << 4;
+	if (llen >= 15)
+		op = lz4_length(op, llen - 15);
+	(void)memcpy(op, lit, llen);
+	op += llen;
+	if (mlen == 0)
+		return (op);
+	*op++ = offset & 0xff;
+	*op++ = offset >> 8;
+	mlen -= LZ4_MINMATCH;
+	*token |= (mlen >= 15 ? 15 : mlen);
+	if (mlen >= 15)
+		op = lz4_length(op, mlen - 15);
+	return (op);
+}
+
+/*
+ * Greedy LZ4 block compression of the n bytes at src into dst, which holds
+ * at least LZ4_BOUND(n) bytes. Return the compressed length.
+ */
+static uint32_t
+lz4_compress(const uint8_t *src, uint32_t n, uint8_t *dst)
+{
+	static uint32_t table[1 << LZ4_HASHLOG]; /* positions + 1 */
+	const uint8_t *ip = src, *anchor = src, *ref;
+	uint8_t *op = dst;
+	uint32_t h, mlen;
+
+	(void)memset(table, 0, sizeof(table));
+	while (n >= LZ4_MFLIMIT && ip <= src + n - LZ4_MFLIMIT) {
+		h = (read32(ip) * 2654435761u) >> (32 - LZ4_HASHLOG);
+		ref = (table[h] != 0 ? src + table[h] - 1 : NULL);
+		table[h] = ip - src + 1;
+		if (ref == NULL || ip - ref > 0xffff ||
+		    read32(ref) != read32(ip)) {
+			ip++;
+			continue;
+		}
+		mlen = LZ4_MINMATCH;
+		while (ip + mlen < src + n - LZ4_LASTLITERALS &&
+		    ref[mlen] == ip[mlen])
+			mlen++;
+		op = lz4_sequence(op, anchor, ip, ip - ref, mlen);
+		ip += mlen;
+		anchor = ip;
+	}
+	op = lz4_sequence(op, anchor, src + n, 0, 0);
+	return (op - dst);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct ent *root, *e, **nodes;
+	uint32_t nnodes, maxnodes, i, j, k, h, nhash, *hash;
+	uint32_t strsiz, off, hoff, soff, size, csize;
+	uint8_t *img, *p, *cbuf;
+	char *strtab;
+	FILE *f;
+	int ch, zflag = 0;
+
+	progname = argv[0];
+	while ((ch = getopt(argc, argv, "z")) != -1) {
+		switch (ch) {
+		case 'z':
+			zflag = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc != 2)
+		usage();
+
+	root = xcalloc(1, sizeof(*root));
+	root->e_name = "";
+	root->e_path = argv[0];
+	root->e_type = INITRD_IMAGE_DIR;
+	scan(root);
+	for (i = 0; i < root->e_nchildren; i++) {
+		if (strcmp(root->e_children[i]->e_name, "dev") == 0)
+			break;
+	}
+	if (i == root->e_nchildren) {
+		e = xcalloc(1, sizeof(*e));
+		e->e_name = "dev";
+		e->e_type = INITRD_IMAGE_DIR;
+		ent_add(root, e);
+		qsort(root->e_children, root->e_nchildren,
+		    sizeof(*root->e_children), &ent_cmp);
+	}
+
+	/* number the nodes breadth first, the queue is the node table. */
+	maxnodes = 64;
+	nodes = xcalloc(maxnodes, sizeof(*nodes));
+	nodes[0] = root;
+	nnodes = 1;
+	for (i = 0; i < nnodes; i++) {
+		e = nodes[i];
+		e->e_id = i;
+		for (j = 0; j < e->e_nchildren; j++) {
+			if (nnodes == maxnodes) {
+				maxnodes *= 2;
+				nodes = realloc(nodes, maxnodes * sizeof(*nodes));
+				if (nodes == NULL)
+					die("%s", "out of memory");
+			}
+			nodes[nnodes++] = e->e_children[j];
+		}
+	}
+
+	/* the string table, names then link targets. */
+	strsiz = 1;
+	for (i = 0; i < nnodes; i++) {
+		strsiz += strlen(nodes[i]->e_name) + 1;
+		if (nodes[i]->e_link != NULL)
+			strsiz += strlen(nodes[i]->e_link) + 1;
+	}
+
+	for (nhash = 2; nhash < 2 * nnodes; nhash *= 2)
+		continue;
+	hoff = sizeof(struct initrd_image_header) +
+	    nnodes * sizeof(struct initrd_image_node);
+	soff = hoff + nhash * sizeof(uint32_t);
+	size = soff + strsiz;
+
+	/* lay out the data, hard links share the first copy. */
+	for (i = 0; i < nnodes; i++) {
+		e = nodes[i];
+		if (e->e_type != INITRD_IMAGE_FILE || e->e_size == 0)
+			continue;
+		for (j = 1; e->e_nlink > 1 && j < i; j++) {
+			if (nodes[j]->e_type == INITRD_IMAGE_FILE &&
+			    nodes[j]->e_size > 0 &&
+			    nodes[j]->e_dev == e->e_dev &&
+			    nodes[j]->e_ino == e->e_ino)
+				break;
+		}
+		if (e->e_nlink > 1 && j < i) {
+			e->e_data  = nodes[j]->e_data;
+			e->e_csize = nodes[j]->e_csize;
+			continue;
+		}
+		load(e);
+		if (zflag) {
+			cbuf = xcalloc(1, LZ4_BOUND(e->e_size));
+			csize = lz4_compress(e->e_buf, e->e_size, cbuf);
+			if (csize < e->e_size) {
+				free(e->e_buf);
+				e->e_buf = cbuf;
+				e->e_csize = csize;
+			} else
+				free(cbuf);
+		}
+		if (e->e_csize == 0)
+			size = align(size);
+		e->e_data = size;
+		if ((uint64_t)size + e->e_size > 0xffffffff - INITRD_IMAGE_ALIGN) {
+			errno = 0;
+			die("%s", "image too big");
+		}
+		size += (e->e_csize != 0 ? e->e_csize : e->e_size);
+	}
+
+	img = xcalloc(1, size);
+	strtab = (char *)img + soff;
+	hash = xcalloc(nhash, sizeof(*hash));
+	for (h = 0; h < nhash; h++)
+		hash[h] = INITRD_NONE;
+	off = 1;
+	for (i = 0; i < nnodes; i++) {
+		e = nodes[i];
+		p = img + sizeof(struct initrd_image_header) +
+		    i * sizeof(struct initrd_image_node);
+		put32(p + 0, off);
+		(void)strcpy(strtab + off, e->e_name);
+		off += strlen(e->e_name) + 1;
+		put32(p + 4, e->e_parent != NULL ? e->e_parent->e_id :
+		    INITRD_NONE);
+		put32(p + 8, e->e_type);
+		put32(p + 12, e->e_size);
+		put32(p + 16, e->e_csize);
+		if (e->e_type == INITRD_IMAGE_SYMLINK) {
+			put32(p + 20, off);
+			(void)strcpy(strtab + off, e->e_link);
+			off += strlen(e->e_link) + 1;
+		} else
+			put32(p + 20, e->e_data);
+		put32(p + 24, e->e_nchildren > 0 ?
+		    e->e_children[0]->e_id : INITRD_NONE);
+		put32(p + 28, e->e_nchildren);
+
+		if (e->e_parent != NULL) {
+			h = initrd_image_hash(e->e_parent->e_id, e->e_name);
+			for (k = h & (nhash - 1); hash[k] != INITRD_NONE;
+			    k = (k + 1) & (nhash - 1))
+				continue;
+			hash[k] = i;
+		}
+
+		if (e->e_buf != NULL)
+			(void)memcpy(img + e->e_data, e->e_buf,
+			    e->e_csize != 0 ? e->e_csize : e->e_size);
+	}
+	for (h = 0; h < nhash; h++)
+		put32(img + hoff + h * sizeof(uint32_t), hash[h]);
+
+	put32(img + 0, INITRD_IMAGE_MAGIC);
+	put32(img + 4, INITRD_IMAGE_VERSION);
+	put32(img + 8, size);
+	put32(img + 12, nnodes);
+	put32(img + 16, sizeof(struct initrd_image_header));
+	put32(img + 20, nhash);
+	put32(img + 24, hoff);
+	put32(img + 28, strsiz);
+	put32(img + 32, soff);
+
+	if ((f = fopen(argv[1], "wb")) == NULL)
+		die("can't create %s", argv[1]);
+	if (fwrite(img, 1, size, f) != size || fclose(f) == EOF)
+		die("can't write %s", argv[1]);
+	return (0);
+}
@@ -5,6 +5,8 @@
  * system. Written for JamesM's kernel development tutorials.
  */
 #include <vfs.h>
+#include <paging.h>
+#include <spinlock.h>
 
 struct vfs_node *vfs_root = NULL; /* The root of the filesystem. */
 
@@ -47,22 +49,415 @@ vfs_close(struct vfs_node *node)
 		node->close(node);
 }
 
-struct dirent *
-vfs_readdir(struct vfs_node *node, uint32_t index)
+int
+vfs_readdir(struct vfs_node *node, uint32_t *cookie, struct dirent *buf,
+    uint32_t n)
 {
 
+	if ((node->flags & VFS_MOUNTPOINT) && node->ptr != NULL)
+		node = node->ptr;
 	if (VFS_ISDIR(node) && node->readdir != NULL)
-		return node->readdir(node, index);
+		return node->readdir(node, cookie, buf, n);
 	else
-		return NULL;
+		return 0;
+}
+
+void
+vfs_dirent(struct dirent *d, const char *name, uint32_t inode)
+{
+	size_t len = strlen(name);
+
+	if (len >= sizeof(d->name))
+		len = sizeof(d->name) - 1;
+	(void)memcpy(d->name, name, len);
+	d->name[len] = '\0';
+	d->inode = inode;
 }
 
 struct vfs_node *
 vfs_finddir(struct vfs_node *node, char *name)
 {
 
+	if ((node->flags & VFS_MOUNTPOINT) && node->ptr != NULL)
+		node = node->ptr;
 	if (VFS_ISDIR(node) && node->finddir != NULL)
 		return node->finddir(node, name);
 	else
 		return NULL;
 }
+
+int
+vfs_map(struct vfs_node *node, uint32_t offset, const void **addrp,
+    uint32_t *lenp)
+{
+
+	if (node->map != NULL)
+		return (node->map(node, offset, addrp, lenp));
+	else
+		return (-1);
+}
+
+void *
+vfs_map_pages(struct vfs_node *node, uint32_t offset, uint32_t len,
+    uint32_t va, struct vm_page_directory *dir)
+{
+	const void *addr;
+	uint32_t avail, kva, end, page;
+
+	if ((va & 0xFFF) != 0 || vfs_map(node, offset, &addr, &avail) == -1 ||
+	    len > avail)
+		return (NULL);
+	end = (uint32_t)addr + len;
+	page = va;
+	for (kva = (uint32_t)addr & ~0xFFF; kva < end; kva += 0x1000) {
+		if (share_page(kva, page, dir) == -1) {
+			/* leave nothing behind. */
+			while (page > va) {
+				page -= 0x1000;
+				unshare_page(page, dir);
+			}
+			return (NULL);
+		}
+		page += 0x1000;
+	}
+	return ((void *)(va + ((uint32_t)addr & 0xFFF)));
+}
+
+int
+vfs_mount(struct vfs_node *mp, struct vfs_node *root)
+{
+
+	if (mp == NULL || root == NULL || !VFS_ISDIR(mp) || !VFS_ISDIR(root))
+		return (-1);
+	mp->ptr = root;
+	mp->flags |= VFS_MOUNTPOINT;
+	vfs_cache_purge(mp);
+	return (0);
+}
+
+
+/* FNV-1a */
+static uint32_t
+vfs_namehash(const char *name)
+{
+	uint32_t h = 2166136261u;
+
+	while (*name != '\0')
+		h = (h ^ (uint8_t)*name++) * 16777619u;
+	return (h);
+}
+
+/* insert without growing, there must be a free slot. */
+static void
+vfs_dirhash_put(struct vfs_node **slots, uint32_t size, struct vfs_node *node)
+{
+	uint32_t i;
+
+	i = vfs_namehash(node->name) & (size - 1);
+	while (slots[i] != NULL)
+		i = (i + 1) & (size - 1);
+	slots[i] = node;
+}
+
+/* make room for at least n nodes, keeping the table at most half full. */
+static int
+vfs_dirhash_grow(struct vfs_dirhash *dh, uint32_t n)
+{
+	struct vfs_node **slots;
+	uint32_t size, i;
+
+	for (size = 8; size < 2 * n; size *= 2)
+		continue;
+	if (size <= dh->dh_size)
+		return (0);
+	if ((slots = kmalloc0(size * sizeof(struct vfs_node *))) == NULL)
+		return (-1);
+	for (i = 0; i < dh->dh_size; i++) {
+		if (dh->dh_slots[i] != NULL)
+			vfs_dirhash_put(slots, size, dh->dh_slots[i]);
+	}
+	kfree(dh->dh_slots);
+	dh->dh_slots = slots;
+	dh->dh_size  = size;
+	return (0);
+}
+
+int
+vfs_dirhash_init(struct vfs_dirhash *dh, uint32_t n)
+{
+
+	dh->dh_slots = NULL;
+	dh->dh_size  = dh->dh_count = 0;
+	return (n > 0 ? vfs_dirhash_grow(dh, n) : 0);
+}
+
+int
+vfs_dirhash_insert(struct vfs_dirhash *dh, struct vfs_node *node)
+{
+
+	if (vfs_dirhash_grow(dh, dh->dh_count + 1) == -1)
+		return (-1);
+	vfs_dirhash_put(dh->dh_slots, dh->dh_size, node);
+	dh->dh_count++;
+	return (0);
+}
+
+struct vfs_node *
+vfs_dirhash_lookup(struct vfs_dirhash *dh, const char *name)
+{
+	struct vfs_node *node;
+	uint32_t i;
+
+	if (dh->dh_size == 0)
+		return (NULL);
+	i = vfs_namehash(name) & (dh->dh_size - 1);
+	while ((node = dh->dh_slots[i]) != NULL) {
+		if (strcmp(node->name, name) == 0)
+			return (node);
+		i = (i + 1) & (dh->dh_size - 1);
+	}
+	return (NULL);
+}
+
+struct vfs_node *
+vfs_dirhash_finddir(struct vfs_node *dir, char *name)
+{
+
+	return (vfs_dirhash_lookup((struct vfs_dirhash *)dir->impl, name));
+}
+
+
+/*
+ * The name cache: what finddir answered for a (directory, name), including
+ * the names it did not find, unless the directory is VFS_NONEGCACHE. The
+ * vfs never frees nodes, so plain pointers are kept. Its entries are
+ * preallocated, the least recently used one is reused for a new name.
+ */
+static struct vfs_dentry {
+	struct vfs_node	*d_parent; /* NULL if unused */
+	struct vfs_node	*d_node;   /* NULL if there is no such name */
+	uint32_t	 d_hash;
+	char		 d_name[VFS_CACHE_NAMELEN];
+	LIST_ENTRY(vfs_dentry)	d_link; /* in its hash chain */
+	TAILQ_ENTRY(vfs_dentry)	d_lru;
+} vfs_dentries[VFS_NCACHE];
+
+static LIST_HEAD(, vfs_dentry)	vfs_dhash[VFS_NCACHEHASH];
+static TAILQ_HEAD(vfs_dlru, vfs_dentry)	vfs_dlru =
+    TAILQ_HEAD_INITIALIZER(vfs_dlru);
+static struct spinlock		vfs_dlock = SPINLOCK_INITIALIZER("vfs_cache");
+
+/* the directories walked by a lookup, to go back up on "..". */
+struct vfs_nameidata {
+	struct vfs_node	*nd_dirs[VFS_MAXDEPTH]; /* nd_dirs[0] is the root */
+	int		 nd_depth;
+	int		 nd_links; /* symlinks followed */
+	char		 nd_name[sizeof(((struct vfs_node *)0)->name)];
+};
+
+
+static uint32_t
+vfs_cache_hash(struct vfs_node *dir, const char *name)
+{
+
+	return (vfs_namehash(name) ^ ((uint32_t)dir * 2654435761u));
+}
+
+/* find (dir, name) with vfs_dlock held, and make it the most recent. */
+static struct vfs_dentry *
+vfs_cache_find(struct vfs_node *dir, const char *name, uint32_t h)
+{
+	struct vfs_dentry *d;
+
+	LIST_FOREACH(d, &vfs_dhash[h & (VFS_NCACHEHASH - 1)], d_link) {
+		if (d->d_hash == h && d->d_parent == dir &&
+		    strcmp(d->d_name, name) == 0) {
+			TAILQ_REMOVE(&vfs_dlru, d, d_lru);
+			TAILQ_INSERT_HEAD(&vfs_dlru, d, d_lru);
+			return (d);
+		}
+	}
+	return (NULL);
+}
+
+/*
+ * Find name in the directory dir, from the cache or asking finddir and
+ * caching its answer.
+ */
+static struct vfs_node *
+vfs_cache_lookup(struct vfs_node *dir, char *name)
+{
+	struct vfs_dentry *d;
+	struct vfs_node *node;
+	uint32_t h, eflags, i;
+
+	if (strlen(name) >= VFS_CACHE_NAMELEN)
+		return (vfs_finddir(dir, name));
+
+	h = vfs_cache_hash(dir, name);
+	eflags = spin_lock_irqsave(&vfs_dlock);
+	if (TAILQ_EMPTY(&vfs_dlru)) {
+		for (i = 0; i < VFS_NCACHE; i++)
+			TAILQ_INSERT_TAIL(&vfs_dlru, &vfs_dentries[i], d_lru);
+	}
+	if ((d = vfs_cache_find(dir, name, h)) != NULL) {
+		node = d->d_node;
+		spin_unlock_irqrestore(&vfs_dlock, eflags);
+		return (node);
+	}
+	spin_unlock_irqrestore(&vfs_dlock, eflags);
+
+	node = vfs_finddir(dir, name);
+	if (node == NULL && (dir->flags & VFS_NONEGCACHE))
+		return (NULL);
+
+	eflags = spin_lock_irqsave(&vfs_dlock);
+	/* someone may have cached it meanwhile. */
+	if ((d = vfs_cache_find(dir, name, h)) == NULL) {
+		d = TAILQ_LAST(&vfs_dlru, vfs_dlru);
+		if (d->d_parent != NULL)
+			LIST_REMOVE(d, d_link);
+		d->d_parent = dir;
+		d->d_hash = h;
+		(void)memcpy(d->d_name, name, strlen(name) + 1);
+		LIST_INSERT_HEAD(&vfs_dhash[h & (VFS_NCACHEHASH - 1)], d,
+		    d_link);
+		TAILQ_REMOVE(&vfs_dlru, d, d_lru);
+		TAILQ_INSERT_HEAD(&vfs_dlru, d, d_lru);
+	}
+	d->d_node = node;
+	spin_unlock_irqrestore(&vfs_dlock, eflags);
+	return (node);
+}
+
+void
+vfs_cache_purge(struct vfs_node *dir)
+{
+	struct vfs_dentry *d;
+	uint32_t eflags, i;
+
+	eflags = spin_lock_irqsave(&vfs_dlock);
+	for (i = 0; i < VFS_NCACHE; i++) {
+		d = &vfs_dentries[i];
+		if (d->d_parent != dir)
+			continue;
+		LIST_REMOVE(d, d_link);
+		d->d_parent = NULL;
+		TAILQ_REMOVE(&vfs_dlru, d, d_lru);
+		TAILQ_INSERT_TAIL(&vfs_dlru, d, d_lru);
+	}
+	spin_unlock_irqrestore(&vfs_dlock, eflags);
+}
+
+
+static struct vfs_node	*vfs_walk(struct vfs_nameidata *nd, const char *path);
+
+/* enter the directory node. */
+static int
+vfs_push(struct vfs_nameidata *nd, struct vfs_node *node)
+{
+
+	if (nd->nd_depth == VFS_MAXDEPTH)
+		return (-1);
+	nd->nd_dirs[nd->nd_depth++] = node;
+	return (0);
+}
+
+/*
+ * Resolve the symlink link, found in the current directory of nd. Its
+ * target is read from it, the filesystem may also have resolved it in ptr.
+ */
+static struct vfs_node *
+vfs_follow(struct vfs_nameidata *nd, struct vfs_node *link)
+{
+	struct vfs_node *node;
+	char *target;
+	uint32_t n;
+
+	if (++nd->nd_links > VFS_MAXSYMLINKS)
+		return (NULL);
+	if ((target = kmalloc(VFS_PATHMAX)) == NULL)
+		return (NULL);
+	n = vfs_read(link, 0, VFS_PATHMAX - 1, target);
+	target[n] = '\0';
+	if (n > 0)
+		node = vfs_walk(nd, target);
+	else if ((node = link->ptr) != NULL && VFS_ISDIR(node) &&
+	    vfs_push(nd, node) == -1)
+		node = NULL;
+	kfree(target);
+	return (node);
+}
+
+/*
+ * Walk path from the current directory of nd, or from its root if path is
+ * absolute. When the result is a directory, it becomes the current one.
+ */
+static struct vfs_node *
+vfs_walk(struct vfs_nameidata *nd, const char *path)
+{
+	struct vfs_node *node = nd->nd_dirs[nd->nd_depth - 1];
+	const char *end;
+
+	if (*path == '/') {
+		nd->nd_depth = 1;
+		node = nd->nd_dirs[0];
+	}
+	for (;;) {
+		while (*path == '/')
+			path++;
+		if (*path == '\0')
+			return (node);
+		if (!VFS_ISDIR(node))
+			return (NULL);
+		for (end = path; *end != '\0' && *end != '/'; end++)
+			continue;
+		if (end - path >= (int)sizeof(nd->nd_name))
+			return (NULL);
+		(void)memcpy(nd->nd_name, path, end - path);
+		nd->nd_name[end - path] = '\0';
+		path = end;
+
+		if (strcmp(nd->nd_name, ".") == 0)
+			continue;
+		if (strcmp(nd->nd_name, "..") == 0) {
+			if (nd->nd_depth > 1)
+				nd->nd_depth--;
+			node = nd->nd_dirs[nd->nd_depth - 1];
+			continue;
+		}
+		node = vfs_cache_lookup(node, nd->nd_name);
+		while (node != NULL && (node->flags & VFS_MOUNTPOINT) &&
+		    node->ptr != NULL)
+			node = node->ptr;
+		if (node == NULL)
+			return (NULL);
+		if ((node->flags & 0x7) == VFS_SYMLINK) {
+			if ((node = vfs_follow(nd, node)) == NULL)
+				return (NULL);
+		} else if (VFS_ISDIR(node) && vfs_push(nd, node) == -1)
+			return (NULL);
+		/* "file/" and "file/name" are errors. */
+		if (*path == '/' && !VFS_ISDIR(node))
+			return (NULL);
+	}
+}
+
+struct vfs_node *
+vfs_lookup(const char *path)
+{
+	struct vfs_nameidata *nd;
+	struct vfs_node *node;
+
+	if (vfs_root == NULL || (nd = kmalloc(sizeof(*nd))) == NULL)
+		return (NULL);
+	node = vfs_root;
+	if ((node->flags & VFS_MOUNTPOINT) && node->ptr != NULL)
+		node = node->ptr;
+	nd->nd_dirs[0] = node;
+	nd->nd_depth = 1;
+	nd->nd_links = 0;
+	node = vfs_walk(nd, path);
+	kfree(nd);
+	return (node);
+}